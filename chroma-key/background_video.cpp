@@ -0,0 +1,116 @@
+// Moving background plates for chroma keying
+
+#include "background_video.hpp"
+
+#include <algorithm>
+
+BackgroundVideo::BackgroundVideo(const std::string& path, EndPolicy policy, size_t capacity)
+    : capture_(path), policy_(policy), capacity_(std::max<size_t>(capacity, 2))
+{
+    opened_ = capture_.isOpened();
+    if (opened_)
+        decoder_ = std::thread([this] { decodeLoop(); });
+}
+
+BackgroundVideo::~BackgroundVideo()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    space_.notify_all();
+    produced_.notify_all();
+    if (decoder_.joinable())
+        decoder_.join();
+}
+
+void BackgroundVideo::decodeLoop()
+{
+    size_t decoded = 0;       // frames handed to the ring in total
+    size_t decodedInPass = 0; // frames since the last rewind
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            space_.wait(lock, [this] { return stopping_ || ring_.size() < capacity_; });
+            if (stopping_)
+                return;
+        }
+
+        // Decode outside the lock; consumers keep reading buffered frames
+        cv::Mat f;
+        if (!capture_.read(f) || f.empty()) {
+            // Loop rewinds, unless the video yields nothing (or cannot seek)
+            if (policy_ == EndPolicy::Loop && decodedInPass > 0 &&
+                capture_.set(cv::CAP_PROP_POS_FRAMES, 0)) {
+                decodedInPass = 0;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            ended_ = true;
+            length_ = decoded;
+            produced_.notify_all();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring_.push_back(f);
+        released_.push_back(releasedAhead_.erase(base_ + ring_.size() - 1) > 0);
+        last_ = f;
+        ++decoded;
+        ++decodedInPass;
+        dropReleased();
+        produced_.notify_all();
+    }
+}
+
+cv::Mat BackgroundVideo::frame(size_t index)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto ready = [&] { return stopping_ || ended_ || index < base_ + ring_.size(); };
+    if (!ready()) {
+        ++stalls_;
+        produced_.wait(lock, ready);
+    }
+
+    if (index >= base_ && index < base_ + ring_.size())
+        return ring_[index - base_];
+    // Past the end: hold the last frame (also when looping failed to rewind)
+    return index >= length_ ? last_ : cv::Mat();
+}
+
+void BackgroundVideo::release(size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < base_)
+        return;
+    if (index >= base_ + ring_.size()) {
+        // Not decoded yet; past the end nothing will be
+        if (!ended_)
+            releasedAhead_.insert(index);
+        return;
+    }
+    released_[index - base_] = true;
+    dropReleased();
+}
+
+// Reuse the slots of the leading frames every plate is done with
+// Called with mutex_ held
+void BackgroundVideo::dropReleased()
+{
+    bool freed = false;
+    while (!released_.empty() && released_.front()) {
+        ring_.pop_front();
+        released_.pop_front();
+        ++base_;
+        freed = true;
+    }
+    if (freed)
+        space_.notify_one();
+}
+
+bool parseEndPolicy(const std::string& name, BackgroundVideo::EndPolicy& policy)
+{
+    if (name == "loop") { policy = BackgroundVideo::EndPolicy::Loop; return true; }
+    if (name == "hold") { policy = BackgroundVideo::EndPolicy::Hold; return true; }
+    return false;
+}
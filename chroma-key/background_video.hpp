@@ -0,0 +1,73 @@
+// Moving background plates for chroma keying
+// Background frames are decoded ahead of the keying on a separate thread into
+// a bounded ring buffer, so keying never waits for video decode unless the
+// decoder genuinely falls behind. Foreground frame i is composited onto
+// background frame i; when the video is shorter than the foreground sequence
+// it either loops or holds its last frame.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+class BackgroundVideo
+{
+public:
+    enum class EndPolicy { Loop, Hold };
+
+    // capacity bounds the decoded frames held at once; it must exceed the
+    // number of foreground frames keyed concurrently
+    BackgroundVideo(const std::string& path, EndPolicy policy, size_t capacity = 16);
+    ~BackgroundVideo();
+
+    BackgroundVideo(const BackgroundVideo&) = delete;
+    BackgroundVideo& operator=(const BackgroundVideo&) = delete;
+
+    bool isOpen() const { return opened_; }
+
+    // Background for foreground frame index; empty if the video has no frames
+    // Blocks only while the decoder has not reached index yet
+    cv::Mat frame(size_t index);
+
+    // Foreground frame index is done with its background; once every earlier
+    // frame is done too, its ring slot is reused for decoding ahead
+    // A frame released before it is decoded (its plate failed to load) is
+    // dropped as soon as the decoder reaches it
+    void release(size_t index);
+
+    // Number of frame() calls that had to wait for the decoder
+    size_t stalls() const { return stalls_; }
+
+private:
+    void decodeLoop();
+    void dropReleased();
+
+    cv::VideoCapture capture_;
+    EndPolicy policy_;
+    size_t capacity_;
+    bool opened_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable produced_;
+    std::condition_variable space_;
+    std::deque<cv::Mat> ring_;   // decoded frames base_, base_ + 1, ...
+    std::deque<bool> released_;  // per ring slot
+    std::set<size_t> releasedAhead_;  // released indices not decoded yet
+    size_t base_ = 0;
+    bool ended_ = false;         // decoder finished: hold reached the end, or no frames
+    size_t length_ = 0;          // frames decoded in total once ended_
+    cv::Mat last_;               // held after the end
+    bool stopping_ = false;
+    std::atomic<size_t> stalls_{ 0 };
+
+    std::thread decoder_;
+};
+
+bool parseEndPolicy(const std::string& name, BackgroundVideo::EndPolicy& policy);
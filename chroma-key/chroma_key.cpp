@@ -6,18 +6,42 @@
 // 2. Find most common color bin
 // 3. Replace pixels close to that color with background pixels
 // 4. Interactive tolerance adjustment via trackbar
+//    (or automatic tolerance from the key-distance histogram with --auto-tol)
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+#ifndef TOOLKIT_HEADLESS
 #include <opencv2/highgui.hpp>
+#endif
+#include "keying.hpp"
+#include "huge_pages.hpp"
+#include "background_video.hpp"
+#include "thumbnail_pyramid.hpp"
+#include "output_sink.hpp"
+#include "async_decode.hpp"
+#include "folder_watcher.hpp"
+#include "thread_pool.hpp"
+#include "cache_manager.hpp"
+#include "idle_prefetcher.hpp"
+#include "progressive_render.hpp"
+#include "memo.hpp"
+#include "image_metrics.hpp"
 #include <iostream>
 #include <string>
-#include <limits>
+#include <vector>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
 
 using std::cout;
 using std::cerr;
 using std::endl;
 
+#ifndef TOOLKIT_HEADLESS
 // Display image with optional scaling for large images
 static void safeImShow(const std::string& winName, const cv::Mat& img, int maxSide = 1400)
 {
@@ -38,191 +62,773 @@ static void safeImShow(const std::string& winName, const cv::Mat& img, int maxSi
         cv::imshow(winName, img);
     }
 }
+#endif
+
+// Settings shared by every image of a batch run
+struct BatchOptions {
+    int buckets = 4;
+    KeySampling sampling;
+    bool autoTol = false;
+    int fixedTol = 32;
+    Prefilter prefilter = Prefilter::None;
+    std::string kernelMode = "auto";
+    std::string kernelCache;
+    OutputSink* sink = nullptr;  // output files or pack archive
+    bool thumbnails = false;
+    ThumbnailSpec thumbSpec;
+    int jobs = 1;                // plates keyed concurrently
+    bool shootKey = false;       // one key color and tolerance for the whole batch
+    int shootSamples = 16;       // plates analyzed for the shoot key
+    std::string bgVideo;         // moving background instead of the still bgPath
+    BackgroundVideo::EndPolicy bgEnd = BackgroundVideo::EndPolicy::Loop;
+};
 
-// Clamp value between min and max
-template <typename T>
-static inline T clamp(T v, T lo, T hi) {
-    return std::max(lo, std::min(hi, v));
-}
+// Background of one run tiled to each foreground size
+// Tilings live in the shared result cache under the background's identity,
+// so another background of the same size never gets this one's plate; the
+// run's own lock makes its concurrent sessions tile a size only once
+class PreparedBackgrounds
+{
+public:
+    void setBackground(const cv::Mat& bg) { bg_ = memoSource(bg); }
+
+    cv::Mat get(cv::Size size)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return memoize("backgrounds", cv::format("%dx%d", size.width, size.height), bg_,
+                       [size](const cv::Mat& bg) { return tileBackground(bg, size); }).mat;
+    }
 
-// Build 3D color histogram with manual binning
-// Returns histogram with shape [buckets, buckets, buckets] for B,G,R channels
-static cv::Mat buildHistogram3D(const cv::Mat& imgBGR, int buckets)
+private:
+    MemoImage bg_;
+    std::mutex mutex_;
+};
+
+// Key color and tolerance shared by every plate of a shoot
+struct ShootKey {
+    cv::Vec3i cBGR;
+    int tol = 0;
+    int plates = 0;  // plates the key was derived from
+};
+
+// Shoot-level key by map-reduce over up to opt.shootSamples evenly spaced
+// plates: each worker decodes a plate, shrinks it (nearest neighbor keeps
+// exact colors) and histograms its sampled region; the histograms are summed
+// and the top bin is the shoot key. With auto tolerance a second parallel
+// pass sums the key-distance histograms of the same plates for one Otsu split.
+static bool computeShootKey(const std::vector<cv::String>& files, const KeyingKernels& kernels,
+                            const BatchOptions& opt, ThreadPool& pool, ShootKey& key)
 {
-    int dims[3] = { buckets, buckets, buckets };
-    cv::Mat hist(3, dims, CV_32S, cv::Scalar::all(0));
-    const int bucketSize = 256 / buckets;
+    const size_t samples = std::min(files.size(), size_t(std::max(opt.shootSamples, 1)));
+    const int MAX_SIDE = 1024;
+
+    struct Plate { cv::Mat small; cv::Mat hist; };
+    std::vector<std::future<Plate>> mapped;
+    for (size_t s = 0; s < samples; ++s) {
+        const cv::String& path = files[s * files.size() / samples];
+        mapped.push_back(pool.submit([&, path] {
+            Plate p;
+            const cv::Mat fg = cv::imread(path, cv::IMREAD_COLOR);
+            if (fg.empty())
+                return p;
+            const double scale = std::min(1.0, double(MAX_SIDE) / std::max(fg.cols, fg.rows));
+            if (scale < 1.0)
+                cv::resize(fg, p.small, cv::Size(), scale, scale, cv::INTER_NEAREST);
+            else
+                p.small = fg;
+
+            KeySampling sampling = opt.sampling;
+            sampling.border = std::max(1, cvRound(sampling.border * scale));
+            sampling.roi = cv::Rect(cvRound(sampling.roi.x * scale), cvRound(sampling.roi.y * scale),
+                                    std::max(1, cvRound(sampling.roi.width * scale)),
+                                    std::max(1, cvRound(sampling.roi.height * scale)));
+            long long sampled = 0;
+            p.hist = sampledHistogram(kernels, p.small, opt.buckets, sampling, sampled);
+            return p;
+        }));
+    }
 
-    for (int r = 0; r < imgBGR.rows; ++r) {
-        const cv::Vec3b* row = imgBGR.ptr<cv::Vec3b>(r);
-        for (int c = 0; c < imgBGR.cols; ++c) {
-            const uchar B = row[c][0];
-            const uchar G = row[c][1];
-            const uchar R = row[c][2];
-
-            int x = B / bucketSize;
-            int y = G / bucketSize;
-            int z = R / bucketSize;
-
-            // Clamp to valid bucket range
-            x = clamp(x, 0, buckets - 1);
-            y = clamp(y, 0, buckets - 1);
-            z = clamp(z, 0, buckets - 1);
-
-            // Increment 3D histogram bin
-            int idx[3] = { x, y, z };
-            hist.at<int>(idx) += 1;
+    std::vector<Plate> plates;
+    cv::Mat hist;
+    for (std::future<Plate>& f : mapped) {
+        Plate p = f.get();
+        if (p.hist.empty())
+            continue;
+        if (hist.empty())
+            hist = p.hist;
+        else
+            cv::add(hist, p.hist, hist);
+        plates.push_back(p);
+    }
+    if (plates.empty())
+        return false;
+
+    cv::Vec3i maxIdx;
+    int maxVal = 0;
+    argmax3D(hist, maxIdx, maxVal);
+    key.cBGR = binCenterBGR(maxIdx, 256 / opt.buckets);
+    key.plates = static_cast<int>(plates.size());
+    key.tol = opt.fixedTol;
+
+    if (opt.autoTol) {
+        std::vector<std::future<std::vector<int>>> distances;
+        for (const Plate& p : plates) {
+            const cv::Mat small = p.small;
+            const cv::Vec3i cBGR = key.cBGR;
+            const Prefilter pf = opt.prefilter;
+            distances.push_back(pool.submit([small, cBGR, pf] {
+                std::vector<int> h(256);
+                buildDistanceHistogram(small, cBGR, h.data(), pf);
+                return h;
+            }));
+        }
+        int total[256] = {};
+        for (auto& f : distances) {
+            const std::vector<int> h = f.get();
+            for (int i = 0; i < 256; ++i)
+                total[i] += h[i];
         }
+        key.tol = otsuThreshold(total);
     }
-    return hist;
+    return true;
 }
 
-// Find bin with maximum count in 3D histogram
-static void argmax3D(const cv::Mat& hist, cv::Vec3i& maxIdx, int& maxVal)
+// State shared by every plate of a batch or watch run
+struct PlateKeyer {
+    const BatchOptions* opt = nullptr;
+    cv::Mat bg;                       // still background (first frame with a video)
+    PreparedBackgrounds backgrounds;  // bg tiled per plate size (unused with a video)
+    BackgroundVideo* video = nullptr; // moving background, frame i for plate i
+    KeyingKernels kernels;
+    ShootKey shoot;                   // used with opt->shootKey
+    std::mutex logMutex;
+    std::atomic<int> failures{0};
+};
+
+// Key one plate as an independent session and write its outputs
+// fg may be preloaded; when empty it is decoded from path
+static void keyPlate(PlateKeyer& k, size_t index, const std::string& path, cv::Mat fg)
 {
-    const int* sizes = hist.size.p;
-    const int bx = sizes[0], by = sizes[1], bz = sizes[2];
-
-    maxVal = std::numeric_limits<int>::min();
-    maxIdx = cv::Vec3i(0, 0, 0);
-
-    for (int x = 0; x < bx; ++x)
-    for (int y = 0; y < by; ++y)
-    for (int z = 0; z < bz; ++z) {
-        int idx[3] = { x, y, z };
-        int v = hist.at<int>(idx);
-        if (v > maxVal) {
-            maxVal = v;
-            maxIdx = cv::Vec3i(x, y, z);
-        }
+    const BatchOptions& opt = *k.opt;
+    if (fg.empty())
+        fg = cv::imread(path, cv::IMREAD_COLOR);
+    if (fg.empty()) {
+        if (k.video)
+            k.video->release(index);
+        std::lock_guard<std::mutex> lock(k.logMutex);
+        cerr << "Warning: Could not load '" << path << "'\n";
+        ++k.failures;
+        return;
+    }
+
+    cv::Vec3i maxIdx;
+    int maxVal = 0;
+    KeyingSession session;
+    session.fg        = fg;
+    session.bg        = k.video ? tileBackground(k.video->frame(index), fg.size())
+                                : k.backgrounds.get(fg.size());
+    bool usedSample = false;
+    session.cBGR      = opt.shootKey ? k.shoot.cBGR
+                      : detectKeyColor(k.kernels, fg, opt.buckets, opt.sampling, maxIdx, maxVal, &usedSample);
+    session.prefilter = opt.prefilter;
+    session.kernels   = k.kernels;
+    const int tol = opt.shootKey ? k.shoot.tol
+                  : opt.autoTol ? autoTolerance(fg, session.cBGR, opt.prefilter) : opt.fixedTol;
+
+    cv::Mat result;
+    session.render(tol, result);
+    if (k.video)
+        k.video->release(index);
+
+    const std::string outName = outputName(path, "_overlay.jpg");
+
+    const bool written = opt.sink->write(outName, result);
+    const bool thumbsFailed = opt.thumbnails &&
+        writeThumbnailPyramid(result, outName, *opt.sink, opt.thumbSpec) > 0;
+
+    std::lock_guard<std::mutex> lock(k.logMutex);
+    if (opt.shootKey)
+        cout << path << ": shoot key\n";
+    else
+        cout << path << ": key [" << session.cBGR[0] << ", " << session.cBGR[1] << ", " << session.cBGR[2] << "]"
+             << (opt.sampling.mode == KeySampling::Mode::Full ? "" : usedSample ? " (sampled)" : " (full frame fallback)")
+             << " tolerance " << tol << (opt.autoTol ? " (auto)" : "") << "\n";
+    if (!written) {
+        cerr << "Warning: Failed to write " << outName << "\n";
+        ++k.failures;
+    }
+    if (thumbsFailed) {
+        cerr << "Warning: Failed to write thumbnails of " << outName << "\n";
+        ++k.failures;
     }
 }
 
-// Calculate representative color from bin center
-static cv::Vec3i binCenterBGR(const cv::Vec3i& idx, int bucketSize)
+// Open the background video of a run, or start decoding the still background
+// The video ring holds enough frames ahead for every worker plus slack
+static bool openBackground(const std::string& bgPath, const BatchOptions& opt,
+                           std::unique_ptr<BackgroundVideo>& video, std::future<cv::Mat>& still)
 {
-    const int cBlue  = idx[0] * bucketSize + bucketSize / 2;
-    const int cGreen = idx[1] * bucketSize + bucketSize / 2;
-    const int cRed   = idx[2] * bucketSize + bucketSize / 2;
-    return cv::Vec3i(cBlue, cGreen, cRed);
+    if (opt.bgVideo.empty()) {
+        still = decodeAsync(bgPath);
+        return true;
+    }
+    video = std::make_unique<BackgroundVideo>(opt.bgVideo, opt.bgEnd, 2 * size_t(opt.jobs) + 8);
+    if (!video->isOpen()) {
+        cerr << "Error: Could not open background video '" << opt.bgVideo << "'\n";
+        return false;
+    }
+    return true;
 }
 
-// Perform chroma key replacement
-// Pixels within tolerance of target color are replaced with background pixels
-static void chromaReplace(const cv::Mat& fg, const cv::Mat& bg,
-                          const cv::Vec3i& cBGR, int tol, cv::Mat& out)
+// Headless keying of every foreground matching a glob pattern
+// Tolerance is either fixed or selected per image, and logged per image
+// Each plate is an independent session on the worker pool
+// With a background video, matches are frames in name order and frame i is
+// keyed onto background frame i
+static int runBatch(const std::string& fgPattern, const std::string& bgPath, const BatchOptions& opt)
 {
-    out.create(fg.size(), fg.type());
+    std::vector<cv::String> files;
+    cv::glob(fgPattern, files, false);
+    if (files.empty()) {
+        cerr << "Error: No foreground matches '" << fgPattern << "'\n";
+        return 1;
+    }
+
+    // Background decodes while the first foreground is decoded; both are
+    // needed to pick the kernels that every session then uses
+    std::unique_ptr<BackgroundVideo> video;
+    std::future<cv::Mat> bgFuture;
+    if (!openBackground(bgPath, opt, video, bgFuture))
+        return 1;
+    cv::Mat firstFg = cv::imread(files[0], cv::IMREAD_COLOR);
+
+    PlateKeyer keyer;
+    keyer.opt = &opt;
+    keyer.video = video.get();
+    keyer.bg = video ? video->frame(0) : bgFuture.get();
+    if (keyer.bg.empty()) {
+        cerr << "Error: Could not load '" << (video ? opt.bgVideo : bgPath) << "'\n";
+        return 1;
+    }
+    keyer.backgrounds.setBackground(keyer.bg);
+
+    if (!firstFg.empty() &&
+        !selectKernels(opt.kernelMode, opt.kernelCache, firstFg, tileBackground(keyer.bg, firstFg.size()),
+                       opt.buckets, opt.fixedTol, keyer.kernels)) {
+        cerr << "Error: Unknown --kernels mode '" << opt.kernelMode << "'\n";
+        return 1;
+    }
+
+    ThreadPool pool(std::min<int>(opt.jobs, int(files.size())));
+
+    if (opt.shootKey) {
+        ShootKey& shoot = keyer.shoot;
+        if (!computeShootKey(files, keyer.kernels, opt, pool, shoot)) {
+            cerr << "Error: None of the sampled plates could be loaded\n";
+            return 1;
+        }
+        cout << "Shoot key [" << shoot.cBGR[0] << ", " << shoot.cBGR[1] << ", " << shoot.cBGR[2] << "]"
+             << " tolerance " << shoot.tol << (opt.autoTol ? " (auto)" : "")
+             << " from " << shoot.plates << " plates\n";
+    }
+
+    std::vector<std::future<void>> done;
+    for (size_t i = 0; i < files.size(); ++i) {
+        cv::Mat preloaded = (i == 0) ? firstFg : cv::Mat();
+        done.push_back(pool.submit([&keyer, &files, i, preloaded] { keyPlate(keyer, i, files[i], preloaded); }));
+    }
+    firstFg.release();
+    for (std::future<void>& f : done)
+        f.get();
+
+    if (video)
+        cout << "Background video: keying waited for decode " << video->stalls() << " times\n";
+    CacheManager::shared().printStats(cout);
+    return keyer.failures == 0 ? 0 : 1;
+}
 
-    for (int r = 0; r < fg.rows; ++r) {
-        const cv::Vec3b* frow = fg.ptr<cv::Vec3b>(r);
-        cv::Vec3b* orow = out.ptr<cv::Vec3b>(r);
+// Watch mode: key every plate that arrives in the directory of fgPattern
+// until interrupted, with background, kernels, worker pool and caches kept
+// warm between plates. Plates take consecutive background video frames.
+static int runWatch(const std::string& fgPattern, const std::string& bgPath, const BatchOptions& opt)
+{
+    if (opt.shootKey) {
+        cerr << "Error: --shoot-key needs the whole batch up front and cannot be used with --watch\n";
+        return 1;
+    }
+    if (!FolderWatcher::supported()) {
+        cerr << "Error: --watch is not supported on this platform (needs inotify)\n";
+        return 1;
+    }
+    FolderWatcher watcher(fgPattern);
+    if (!watcher.isOpen()) {
+        cerr << "Error: Could not watch '" << watcher.dir() << "'\n";
+        return 1;
+    }
+    if (watcher.watches(opt.sink->dir())) {
+        cerr << "Error: Outputs would land in the watched directory '" << watcher.dir()
+             << "' and be picked up again; choose another --out-dir or --pack\n";
+        return 1;
+    }
 
-        int br = (bg.rows > 0) ? (r % bg.rows) : 0;
-        const cv::Vec3b* brow = (bg.rows > 0) ? bg.ptr<cv::Vec3b>(br) : nullptr;
+    std::unique_ptr<BackgroundVideo> video;
+    std::future<cv::Mat> bgFuture;
+    if (!openBackground(bgPath, opt, video, bgFuture))
+        return 1;
 
-        for (int c = 0; c < fg.cols; ++c) {
-            const cv::Vec3b fpx = frow[c];
-            const int dB = std::abs(int(fpx[0]) - cBGR[0]);
-            const int dG = std::abs(int(fpx[1]) - cBGR[1]);
-            const int dR = std::abs(int(fpx[2]) - cBGR[2]);
+    PlateKeyer keyer;
+    keyer.opt = &opt;
+    keyer.video = video.get();
+    keyer.bg = video ? video->frame(0) : bgFuture.get();
+    if (keyer.bg.empty()) {
+        cerr << "Error: Could not load '" << (video ? opt.bgVideo : bgPath) << "'\n";
+        return 1;
+    }
+    keyer.backgrounds.setBackground(keyer.bg);
 
-            const bool isClose = (dB <= tol) && (dG <= tol) && (dR <= tol);
+    // No plate exists yet, so the kernels are chosen on the background
+    if (!selectKernels(opt.kernelMode, opt.kernelCache, keyer.bg, keyer.bg,
+                       opt.buckets, opt.fixedTol, keyer.kernels)) {
+        cerr << "Error: Unknown --kernels mode '" << opt.kernelMode << "'\n";
+        return 1;
+    }
 
-            if (isClose && brow != nullptr) {
-                int bc = (bg.cols > 0) ? (c % bg.cols) : 0;
-                orow[c] = brow[bc];
-            } else {
-                orow[c] = fpx;
-            }
+    cout << "Watching " << watcher.dir() << " for plates (Ctrl-C stops)" << endl;
+    std::atomic<size_t> next(0);
+    const size_t left = runWatchLoop(watcher, opt.jobs,
+        [&](const std::string& path) { keyPlate(keyer, next++, path, cv::Mat()); },
+        [&] {
+            if (!opt.sink->flush())
+                cerr << "Warning: Failed to flush outputs\n";
+            cout << next << " plates keyed, waiting for more" << endl;
+        });
+
+    if (left > 0)
+        cout << "Stopped with " << left << " arrived plates not keyed\n";
+    CacheManager::shared().printStats(cout);
+    return keyer.failures == 0 ? 0 : 1;
+}
+
+// Keying throughput and dTLB misses with the standard allocator and huge pages
+// Frames smaller than 8K are upscaled so the working set exceeds TLB reach
+static void measureAllocators(const cv::Mat& fgIn, const cv::Mat& bgIn, const cv::Vec3i& cBGR,
+                              int tol, int buckets, int iterations)
+{
+    HugePageAllocator thp(HugePageAllocator::Mode::Transparent);
+    HugePageAllocator explicitPages(HugePageAllocator::Mode::Explicit);
+    struct Variant { const char* name; cv::MatAllocator* allocator; };
+    const Variant variants[] = {
+        { "standard",    cv::Mat::getStdAllocator() },
+        { "thp",         &thp },
+        { "explicit",    &explicitPages },
+    };
+
+    const cv::Size frameSize(std::max(fgIn.cols, 7680), std::max(fgIn.rows, 4320));
+    TlbMissCounter counter;
+    if (!counter.available())
+        cout << "dTLB counter unavailable (perf_event_open not permitted), timing only\n";
+
+    cout << "Measuring " << frameSize.width << "x" << frameSize.height
+         << ", " << iterations << " iterations per allocator\n";
+
+    for (const Variant& v : variants) {
+        ScopedDefaultAllocator guard(v.allocator);
+        cv::Mat fg, bg, out;
+        cv::resize(fgIn, fg, frameSize, 0, 0, cv::INTER_NEAREST);
+        bg = bgIn.clone();
+
+        // Warm-up faults in all pages before measuring
+        buildHistogram3D(fg, buckets);
+        chromaReplace(fg, bg, cBGR, tol, out);
+
+        counter.start();
+        const int64 t0 = cv::getTickCount();
+        for (int i = 0; i < iterations; ++i) {
+            buildHistogram3D(fg, buckets);
+            chromaReplace(fg, bg, cBGR, tol, out);
         }
+        const double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency() / iterations;
+        const long long misses = counter.stop();
+
+        cout << "  " << v.name << ": " << ms << " ms/frame, "
+             << (fg.total() / 1e6) / (ms / 1000.0) << " MPix/s";
+        if (misses >= 0)
+            cout << ", " << misses / iterations << " dTLB misses/frame";
+        cout << "\n";
     }
+
+    cout << "  huge-page buffers: thp " << thp.transparentCount()
+         << ", explicit " << explicitPages.explicitCount()
+         << " (+" << explicitPages.transparentCount() << " fell back to thp)\n";
+}
+
+#ifndef TOOLKIT_HEADLESS
+// Everything an overlay depends on besides the session's plates
+static std::string overlayParams(const KeyingSession& session, int tol)
+{
+    return cv::format("tol=%d,key=%d/%d/%d,denoise=%d,kernels=%s/%s", tol,
+                      session.cBGR[0], session.cBGR[1], session.cBGR[2],
+                      static_cast<int>(session.prefilter),
+                      session.kernels.histogramName.c_str(), session.kernels.replaceName.c_str());
+}
+
+// Overlay for a tolerance, memoized under the identity of the session's
+// plates (registered once per session) and its key settings
+// Rendered into a fresh Mat, since cached results must never be written to
+static cv::Mat cachedOverlay(const KeyingSession& session, const MemoImage& plates, int tol)
+{
+    return memoize("overlay", overlayParams(session, tol), plates, [&](const cv::Mat&) {
+        cv::Mat out;
+        session.render(tol, out);
+        return out;
+    }).mat;
 }
 
 // Context for interactive tolerance trackbar
+// Compute state lives in the session; the context only adds the UI around it
 struct OverlayUIContext {
-    cv::Mat fg;
-    cv::Mat bg;
-    cv::Vec3i cBGR;
+    KeyingSession session;
+    MemoImage plates;                  // identity of the session's fg/bg pair
     int tolInit;
-    int tolMax;
     std::string winName;
     std::string tkName;
+    std::string outPath;
     cv::Mat result;
+    KeyingSession proxy;               // downscaled plates for coarse previews
+    double proxyScale = 1.0;
+    ProgressiveRenderer* fine = nullptr;
+    IdlePrefetcher* prefetcher = nullptr;
+    IdleTimer idle;
+    bool suspended = true;  // set while controls are initialized, callbacks skip rendering
 };
 
+// Show a full-resolution overlay and save it
+static void presentOverlay(OverlayUIContext& ctx, const cv::Mat& overlay)
+{
+    ctx.result = overlay;
+    safeImShow(ctx.winName, ctx.result);
+    cv::imwrite(ctx.outPath, ctx.result);
+}
+
 // Trackbar callback - recomputes overlay when tolerance changes
 static void onToleranceChange(int /*pos*/, void* userdata)
 {
     auto* ctx = reinterpret_cast<OverlayUIContext*>(userdata);
-    if (!ctx) return;
+    if (!ctx || ctx->suspended) return;
+
+    if (ctx->prefetcher)
+        ctx->prefetcher->cancel();
+    ctx->idle.changed();
+    const int tol = cv::getTrackbarPos(ctx->tkName, ctx->winName);
+
+    // Small plates and cached results are shown directly; otherwise a proxy
+    // preview first, replaced by the full-resolution result from the event loop
+    if (!ctx->fine || ctx->proxyScale >= 1.0 || memoCached("overlay", overlayParams(ctx->session, tol), ctx->plates)) {
+        if (ctx->fine)
+            ctx->fine->cancel();
+        presentOverlay(*ctx, cachedOverlay(ctx->session, ctx->plates, tol));
+        return;
+    }
 
-    int tol = cv::getTrackbarPos(ctx->tkName, ctx->winName);
-    tol = clamp(tol, 0, ctx->tolMax);
+    cv::Mat preview, shown;
+    ctx->proxy.render(tol, preview);
+    const cv::Size full = ctx->session.fg.size();
+    const double s = std::min(1.0, 1400.0 / std::max(full.width, full.height));
+    cv::resize(preview, shown, cv::Size(cvRound(full.width * s), cvRound(full.height * s)), 0, 0, cv::INTER_NEAREST);
+    safeImShow(ctx->winName, shown);
 
-    chromaReplace(ctx->fg, ctx->bg, ctx->cBGR, tol, ctx->result);
-    safeImShow(ctx->winName, ctx->result);
+    const KeyingSession* session = &ctx->session;
+    const MemoImage plates = ctx->plates;
+    ctx->fine->request([session, plates, tol] { return cachedOverlay(*session, plates, tol); });
+}
 
-    cv::imwrite("overlay.jpg", ctx->result);
+// Queue tolerances within +-4 of the current one, nearest first, while the
+// slider rests
+static void prefetchTolerances(OverlayUIContext& ctx)
+{
+    const int pos = cv::getTrackbarPos(ctx.tkName, ctx.winName);
+    const KeyingSession* session = &ctx.session;
+    const MemoImage plates = ctx.plates;
+    std::vector<IdlePrefetcher::Task> tasks;
+    for (int k = 1; k <= 4; ++k) {
+        for (int v : { pos + k, pos - k }) {
+            if (v >= 0 && v <= session->tolMax)
+                tasks.push_back([session, plates, v] { cachedOverlay(*session, plates, v); });
+        }
+    }
+    ctx.prefetcher->schedule(std::move(tasks));
 }
+#endif
 
-int main()
+int main(int argc, char** argv)
 {
-    // Load foreground and background images
-    const std::string fgPath = "foreground.jpg";
-    const std::string bgPath = "background.jpg";
+    const double startupMs = processStartupMs();
+    const cv::String keys =
+        "{help h usage ? |                | print this message }"
+        "{fg             | foreground.jpg | foreground image (glob pattern in batch mode) }"
+        "{bg             | background.jpg | background image }"
+        "{out            | overlay.jpg    | output image for interactive mode }"
+        "{tol            | -1             | fixed tolerance (default: half a histogram bucket) }"
+        "{auto-tol       |                | select tolerance from the key-distance histogram }"
+        "{denoise        | none           | prefilter for the key decision: none, median3 or box3 }"
+        "{batch          |                | key every --fg match without opening windows }"
+        "{watch          |                | keep running and key plates arriving in the --fg directory (batch options apply) }"
+        "{thumbs         |                | also write 1/2, 1/4, 1/8 and fixed-width thumbnails of each output }"
+        "{thumb-width    | 256            | width of the fixed-width thumbnail }"
+        "{kernels        | auto           | histogram/replace kernels: custom, builtin, bench or auto (cached per host) }"
+        "{kernel-cache   |                | file caching the auto kernel choice per host (default: per-user cache dir) }"
+        "{hugepages      | off            | large frame allocator: off, thp or explicit }"
+        "{measure-tlb    | 0              | compare allocators over N keying iterations and exit }"
+        "{accuracy       | 0              | time and compare approximate modes to the exact path over N runs and exit }"
+        "{jobs           | 0              | batch mode: plates keyed concurrently (0 = one per CPU) }"
+        "{shoot-key      |                | batch mode: one key color and tolerance for all plates (parallel map-reduce) }"
+        "{shoot-samples  | 16             | plates sampled for --shoot-key }"
+        "{key-sample     | full           | key detection region: full, border or an ROI x,y,w,h }"
+        "{key-border     | 32             | width of the border strips for --key-sample=border }"
+        "{bg-video       |                | background video; batch frame i is keyed onto video frame i }"
+        "{bg-end         | loop           | shorter background video at its end: loop or hold the last frame }"
+        "{cache-mb       | 512            | byte budget shared by all result caches, in MB }"
+        "{out-dir        | .              | output directory for batch mode }"
+        "{pack           |                | batch mode: append outputs to pack files in this directory }"
+        "{startup-time   |                | print the time from process start to main (library loading) and exit }";
+
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("Chroma key compositing");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    if (parser.has("startup-time")) {
+        if (startupMs < 0.0)
+            cerr << "Startup time unavailable on this platform\n";
+        else
+            cout << "Startup: " << startupMs << " ms from process start to main\n";
+        return 0;
+    }
 
-    cv::Mat fg = cv::imread(fgPath, cv::IMREAD_COLOR);
-    cv::Mat bg = cv::imread(bgPath, cv::IMREAD_COLOR);
+    const std::string fgPath = parser.get<cv::String>("fg");
+    const std::string bgPath = parser.get<cv::String>("bg");
+    const std::string bgVideo = parser.has("bg-video") ? parser.get<cv::String>("bg-video") : "";
+    const bool autoTol = parser.has("auto-tol");
+    if (!parser.check()) {
+        parser.printErrors();
+        return 1;
+    }
 
-    if (fg.empty() || bg.empty()) {
-        cerr << "Error: Could not load 'foreground.jpg' and 'background.jpg'\n";
+    // Installed before any Mat is allocated; intentionally never freed since
+    // buffers cached inside OpenCV may be released after main returns
+    const std::string hugePages = parser.get<cv::String>("hugepages");
+    if (hugePages == "thp" || hugePages == "explicit") {
+        cv::Mat::setDefaultAllocator(new HugePageAllocator(hugePages == "explicit"
+            ? HugePageAllocator::Mode::Explicit
+            : HugePageAllocator::Mode::Transparent));
+    } else if (hugePages != "off") {
+        cerr << "Error: Unknown --hugepages mode '" << hugePages << "'\n";
+        return 1;
+    }
+
+    CacheManager::shared().setBudget(size_t(std::max(parser.get<int>("cache-mb"), 0)) << 20);
+    CacheManager::shared().setCompressed("overlay", true);
+
+    Prefilter prefilter = Prefilter::None;
+    if (!parsePrefilter(parser.get<cv::String>("denoise"), prefilter)) {
+        cerr << "Error: Unknown --denoise mode '" << parser.get<cv::String>("denoise") << "'\n";
+        return 1;
+    }
+
+    KeySampling sampling;
+    sampling.border = parser.get<int>("key-border");
+    if (!parseKeySampling(parser.get<cv::String>("key-sample"), sampling)) {
+        cerr << "Error: Unknown --key-sample '" << parser.get<cv::String>("key-sample") << "'\n";
         return 1;
     }
 
-    // Build 3D histogram of foreground (manual implementation)
     const int buckets = 4;
     const int bucketSize = 256 / buckets;
-    cv::Mat hist = buildHistogram3D(fg, buckets);
+    const int tolMax = std::max(bucketSize, 255);
+    const int fixedTol = parser.get<int>("tol") >= 0
+        ? clamp(parser.get<int>("tol"), 0, tolMax)
+        : bucketSize / 2;
+
+    const bool thumbnails = parser.has("thumbs");
+    ThumbnailSpec thumbSpec;
+    thumbSpec.widths = { parser.get<int>("thumb-width") };
+
+    const std::string kernelCache = parser.get<cv::String>("kernel-cache").empty()
+        ? defaultKernelCachePath() : parser.get<cv::String>("kernel-cache");
+
+    if (parser.has("batch") || parser.has("watch")) {
+        BatchOptions opt;
+        opt.buckets    = buckets;
+        opt.sampling   = sampling;
+        opt.shootKey   = parser.has("shoot-key");
+        opt.shootSamples = parser.get<int>("shoot-samples");
+        opt.autoTol    = autoTol;
+        opt.fixedTol   = fixedTol;
+        opt.prefilter  = prefilter;
+        opt.thumbnails = thumbnails;
+        opt.thumbSpec  = thumbSpec;
+        opt.kernelMode  = parser.get<cv::String>("kernels");
+        opt.kernelCache = kernelCache;
+        opt.jobs = parser.get<int>("jobs") > 0 ? parser.get<int>("jobs") : cv::getNumberOfCPUs();
+        opt.bgVideo = bgVideo;
+        if (!parseEndPolicy(parser.get<cv::String>("bg-end"), opt.bgEnd)) {
+            cerr << "Error: Unknown --bg-end policy '" << parser.get<cv::String>("bg-end") << "'\n";
+            return 1;
+        }
 
-    // Find most common color bin
+        std::string sinkError;
+        std::unique_ptr<OutputSink> sink = makeOutputSink(parser.get<cv::String>("out-dir"),
+            parser.has("pack") ? parser.get<cv::String>("pack") : cv::String(), sinkError);
+        if (!sink) {
+            cerr << "Error: " << sinkError << "\n";
+            return 1;
+        }
+        opt.sink = sink.get();
+        return parser.has("watch") ? runWatch(fgPath, bgPath, opt) : runBatch(fgPath, bgPath, opt);
+    }
+
+    // Load foreground and background images concurrently
+    // (interactive keying uses the first frame of a background video as plate)
+    std::future<cv::Mat> bgFuture = bgVideo.empty() ? decodeAsync(bgPath) :
+        std::async(std::launch::async, [bgVideo] {
+            cv::VideoCapture capture(bgVideo);
+            cv::Mat first;
+            capture.read(first);
+            return first;
+        });
+    cv::Mat fg = cv::imread(fgPath, cv::IMREAD_COLOR);
+    if (fg.empty()) {
+        cerr << "Error: Could not load '" << fgPath << "'\n";
+        return 1;
+    }
+
+    // Build 3D histogram of foreground (manual implementation)
+    // and find most common color bin while the background is still decoding
+    // The kernel benchmark needs both images, so the histogram of the
+    // foreground uses the custom kernel unless the choice is forced
+    const std::string kernelMode = parser.get<cv::String>("kernels");
+    KeyingKernels kernels = (kernelMode == "builtin") ? builtinKernels() : KeyingKernels();
     cv::Vec3i maxIdx;
     int maxVal = 0;
-    argmax3D(hist, maxIdx, maxVal);
-    cv::Vec3i cBGR = binCenterBGR(maxIdx, bucketSize);
+    bool usedSample = false;
+    cv::Vec3i cBGR = detectKeyColor(kernels, fg, buckets, sampling, maxIdx, maxVal, &usedSample);
+    if (sampling.mode != KeySampling::Mode::Full && !usedSample)
+        cout << "No bin dominates the key sample, detected on the full frame\n";
+
+    cv::Mat bg = bgFuture.get();
+    if (bg.empty()) {
+        cerr << "Error: Could not load '" << (bgVideo.empty() ? bgPath : bgVideo) << "'\n";
+        return 1;
+    }
+    bg = tileBackground(bg, fg.size());
+    if (!selectKernels(kernelMode, kernelCache, fg, bg, buckets, fixedTol, kernels)) {
+        cerr << "Error: Unknown --kernels mode '" << kernelMode << "'\n";
+        return 1;
+    }
+    cout << "Kernels: histogram " << kernels.histogramName << ", replace " << kernels.replaceName << "\n";
 
     cout << "Most common bin (B,G,R): [" << maxIdx[0] << ", " << maxIdx[1] << ", " << maxIdx[2] << "]\n";
     cout << "Representative color:     [" << cBGR[0]  << ", " << cBGR[1]  << ", " << cBGR[2]  << "]\n";
     cout << "Pixel count: " << maxVal << endl;
 
+    int tolInit = fixedTol;
+    if (autoTol) {
+        tolInit = clamp(autoTolerance(fg, cBGR, prefilter), 0, tolMax);
+        cout << "Auto tolerance: " << tolInit << endl;
+    }
+
+    if (parser.get<int>("measure-tlb") > 0) {
+        measureAllocators(fg, bg, cBGR, tolInit, buckets, parser.get<int>("measure-tlb"));
+        return 0;
+    }
+
+    KeyingSession session;
+    session.fg        = fg;
+    session.bg        = bg;
+    session.cBGR      = cBGR;
+    session.tolMax    = tolMax;
+    session.prefilter = prefilter;
+    session.kernels   = kernels;
+    const std::string outPath = parser.get<cv::String>("out");
+
+    if (parser.get<int>("accuracy") > 0) {
+        reportAccuracy(session, sampling, buckets, tolInit, parser.get<int>("accuracy"));
+        return 0;
+    }
+
+    cv::Mat result;
+#ifdef TOOLKIT_HEADLESS
+    // No windows in headless builds: key once at the initial tolerance
+    session.render(tolInit, result);
+#else
     // Setup interactive window with tolerance trackbar
     OverlayUIContext ctx;
-    ctx.fg      = fg;
-    ctx.bg      = bg;
-    ctx.cBGR    = cBGR;
-    ctx.tolInit = bucketSize / 2;
-    ctx.tolMax  = std::max(bucketSize, 255);
+    ctx.session = session;
+    ctx.plates = memoSource(session.fg);
+    ctx.tolInit = tolInit;
     ctx.winName = "Chroma Key Result";
     ctx.tkName  = "Tolerance";
+    ctx.outPath = outPath;
+
+    ctx.proxyScale = proxyScale(fg.size());
+    if (ctx.proxyScale < 1.0) {
+        // Nearest neighbor keeps exact key colors in the preview
+        cv::Mat proxyFg, proxyBg;
+        cv::resize(fg, proxyFg, cv::Size(), ctx.proxyScale, ctx.proxyScale, cv::INTER_NEAREST);
+        cv::resize(bg, proxyBg, proxyFg.size(), 0, 0, cv::INTER_NEAREST);
+        ctx.proxy = ctx.session;
+        ctx.proxy.fg = proxyFg;
+        ctx.proxy.bg = proxyBg;
+    }
 
     cv::namedWindow(ctx.winName, cv::WINDOW_AUTOSIZE);
-    cv::createTrackbar(ctx.tkName, ctx.winName, nullptr, ctx.tolMax, onToleranceChange, &ctx);
+    cv::createTrackbar(ctx.tkName, ctx.winName, nullptr, ctx.session.tolMax, onToleranceChange, &ctx);
     cv::setTrackbarPos(ctx.tkName, ctx.winName, ctx.tolInit);
 
-    // Generate initial result
+    // Generate initial result once all controls are set
+    ctx.suspended = false;
     onToleranceChange(0, &ctx);
     cv::moveWindow(ctx.winName, 60, 60);
 
+    // Neighboring tolerances are precomputed while the user pauses, and
+    // changes on large plates render coarse first with the full result
+    // delivered by the event loop; both are declared after the context so
+    // their workers stop before it goes away
+    IdlePrefetcher prefetcher;
+    ProgressiveRenderer fine;
+    ctx.prefetcher = &prefetcher;
+    ctx.fine = &fine;
+
     // Wait for user to exit
     for (;;) {
         int key = cv::waitKey(30);
         if (key == 27 || key == 'q' || key == 'Q' || key == ' ')
             break;
+        cv::Mat overlay;
+        if (fine.poll(overlay))
+            presentOverlay(ctx, overlay);
+        if (ctx.idle.idleFor(150.0))
+            prefetchTolerances(ctx);
     }
 
+    // Exit saves the full-resolution result of the last change
+    cv::Mat overlay;
+    if (fine.wait(overlay))
+        ctx.result = overlay;
+
     cv::destroyAllWindows();
-    if (!ctx.result.empty())
-        cv::imwrite("overlay.jpg", ctx.result);
+    result = ctx.result;
+#endif
+
+    if (!result.empty()) {
+        if (!cv::imwrite(outPath, result))
+            cerr << "Warning: Failed to write " << outPath << "\n";
+        if (thumbnails) {
+            FileSink files;
+            writeThumbnailPyramid(result, outPath, files, thumbSpec);
+        }
+    }
 
     return 0;
 }
\ No newline at end of file
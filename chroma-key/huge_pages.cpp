@@ -0,0 +1,189 @@
+// Huge-page backed cv::MatAllocator and dTLB miss counter
+
+#include "huge_pages.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = size_t(1) << 21;
+
+// How a buffer was obtained, stored in UMatData::userdata
+enum class Backing : intptr_t { Explicit = 1, Transparent = 2 };
+
+inline size_t roundUp(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+void* mapHugePages(size_t bytes, HugePageAllocator::Mode mode, Backing& backing)
+{
+#ifdef __linux__
+    const size_t len = roundUp(bytes, HUGE_PAGE_SIZE);
+
+    if (mode == HugePageAllocator::Mode::Explicit) {
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            backing = Backing::Explicit;
+            return p;
+        }
+        // No reserved hugetlbfs pages: use transparent huge pages instead
+    }
+
+    void* p = nullptr;
+    if (posix_memalign(&p, HUGE_PAGE_SIZE, len) != 0)
+        return nullptr;
+    madvise(p, len, MADV_HUGEPAGE);
+    backing = Backing::Transparent;
+    return p;
+#else
+    (void)bytes; (void)mode; (void)backing;
+    return nullptr;
+#endif
+}
+
+void unmapHugePages(void* p, size_t bytes, Backing backing)
+{
+#ifdef __linux__
+    if (backing == Backing::Explicit)
+        munmap(p, roundUp(bytes, HUGE_PAGE_SIZE));
+    else
+        std::free(p);
+#else
+    (void)p; (void)bytes; (void)backing;
+#endif
+}
+
+} // namespace
+
+HugePageAllocator::HugePageAllocator(Mode mode, size_t minBytes)
+    : mode_(mode), minBytes_(minBytes)
+{
+}
+
+cv::UMatData* HugePageAllocator::allocate(int dims, const int* sizes, int type, void* data0,
+                                          size_t* step, cv::AccessFlag flags,
+                                          cv::UMatUsageFlags usageFlags) const
+{
+    cv::MatAllocator* stdAllocator = cv::Mat::getStdAllocator();
+    if (data0)
+        return stdAllocator->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i)
+        total *= sizes[i];
+    if (total < minBytes_)
+        return stdAllocator->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+
+    Backing backing = Backing::Transparent;
+    void* data = mapHugePages(total, mode_, backing);
+    if (!data)
+        return stdAllocator->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+
+    if (step) {
+        size_t s = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            step[i] = s;
+            s *= sizes[i];
+        }
+    }
+
+    if (backing == Backing::Explicit)
+        ++explicitCount_;
+    else
+        ++transparentCount_;
+
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = static_cast<uchar*>(data);
+    u->size = total;
+    u->userdata = reinterpret_cast<void*>(static_cast<intptr_t>(backing));
+    return u;
+}
+
+bool HugePageAllocator::allocate(cv::UMatData* u, cv::AccessFlag /*accessFlags*/,
+                                 cv::UMatUsageFlags /*usageFlags*/) const
+{
+    return u != nullptr;
+}
+
+void HugePageAllocator::deallocate(cv::UMatData* u) const
+{
+    if (!u)
+        return;
+
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    const Backing backing = static_cast<Backing>(reinterpret_cast<intptr_t>(u->userdata));
+    unmapHugePages(u->origdata, u->size, backing);
+    u->origdata = nullptr;
+    delete u;
+}
+
+ScopedDefaultAllocator::ScopedDefaultAllocator(cv::MatAllocator* allocator)
+    : previous_(cv::Mat::getDefaultAllocator())
+{
+    cv::Mat::setDefaultAllocator(allocator);
+}
+
+ScopedDefaultAllocator::~ScopedDefaultAllocator()
+{
+    cv::Mat::setDefaultAllocator(previous_);
+}
+
+TlbMissCounter::TlbMissCounter()
+    : fd_(-1)
+{
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+}
+
+TlbMissCounter::~TlbMissCounter()
+{
+#ifdef __linux__
+    if (fd_ >= 0)
+        close(fd_);
+#endif
+}
+
+void TlbMissCounter::start()
+{
+#ifdef __linux__
+    if (fd_ < 0) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+long long TlbMissCounter::stop()
+{
+#ifdef __linux__
+    if (fd_ < 0) return -1;
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    long long count = 0;
+    if (read(fd_, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count)))
+        return -1;
+    return count;
+#else
+    return -1;
+#endif
+}
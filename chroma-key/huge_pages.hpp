@@ -0,0 +1,74 @@
+// Huge-page backed cv::MatAllocator and dTLB miss counter
+// Large frames streamed by the keying kernels span thousands of 4 KiB pages;
+// backing them with 2 MiB pages cuts dTLB misses considerably
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <cstddef>
+
+// Allocator for cv::Mat that backs buffers of at least minBytes with huge pages
+// Transparent: 2 MiB aligned heap block advised with MADV_HUGEPAGE
+// Explicit:    MAP_HUGETLB mapping (needs reserved pages in /proc/sys/vm/nr_hugepages),
+//              falls back to transparent pages when none are available
+// Huge-page blocks are 2 MiB aligned, so rows start on 64-byte boundaries
+// whenever the row size is a multiple of 64. Smaller buffers and user
+// data are delegated to OpenCV's standard allocator.
+class HugePageAllocator : public cv::MatAllocator
+{
+public:
+    enum class Mode { Transparent, Explicit };
+
+    explicit HugePageAllocator(Mode mode, size_t minBytes = size_t(1) << 21);
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags,
+                  cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    // Number of buffers placed in explicit / transparent huge pages so far
+    size_t explicitCount() const { return explicitCount_.load(); }
+    size_t transparentCount() const { return transparentCount_.load(); }
+
+private:
+    Mode mode_;
+    size_t minBytes_;
+    mutable std::atomic<size_t> explicitCount_{0};
+    mutable std::atomic<size_t> transparentCount_{0};
+};
+
+// Installs an allocator as cv::Mat default for the lifetime of the guard
+// Mats allocated while installed must be released before the guard ends
+class ScopedDefaultAllocator
+{
+public:
+    explicit ScopedDefaultAllocator(cv::MatAllocator* allocator);
+    ~ScopedDefaultAllocator();
+
+    ScopedDefaultAllocator(const ScopedDefaultAllocator&) = delete;
+    ScopedDefaultAllocator& operator=(const ScopedDefaultAllocator&) = delete;
+
+private:
+    cv::MatAllocator* previous_;
+};
+
+// Counts user-space dTLB load misses of this process via perf_event_open
+// available() is false when perf events are not permitted or not supported
+class TlbMissCounter
+{
+public:
+    TlbMissCounter();
+    ~TlbMissCounter();
+
+    TlbMissCounter(const TlbMissCounter&) = delete;
+    TlbMissCounter& operator=(const TlbMissCounter&) = delete;
+
+    bool available() const { return fd_ >= 0; }
+    void start();
+    long long stop();
+
+private:
+    int fd_;
+};
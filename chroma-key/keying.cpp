@@ -0,0 +1,638 @@
+// Chroma key compute kernels and keying sessions
+
+#include "keying.hpp"
+#include "image_metrics.hpp"
+#include "progressive_render.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <iostream>
+#include <limits>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+
+using std::cout;
+
+// Build 3D color histogram with manual binning
+// Returns histogram with shape [buckets, buckets, buckets] for B,G,R channels
+cv::Mat buildHistogram3D(const cv::Mat& imgBGR, int buckets)
+{
+    int dims[3] = { buckets, buckets, buckets };
+    cv::Mat hist(3, dims, CV_32S, cv::Scalar::all(0));
+    const int bucketSize = 256 / buckets;
+
+    for (int r = 0; r < imgBGR.rows; ++r) {
+        const cv::Vec3b* row = imgBGR.ptr<cv::Vec3b>(r);
+        for (int c = 0; c < imgBGR.cols; ++c) {
+            const uchar B = row[c][0];
+            const uchar G = row[c][1];
+            const uchar R = row[c][2];
+
+            int x = B / bucketSize;
+            int y = G / bucketSize;
+            int z = R / bucketSize;
+
+            // Clamp to valid bucket range
+            x = clamp(x, 0, buckets - 1);
+            y = clamp(y, 0, buckets - 1);
+            z = clamp(z, 0, buckets - 1);
+
+            // Increment 3D histogram bin
+            int idx[3] = { x, y, z };
+            hist.at<int>(idx) += 1;
+        }
+    }
+    return hist;
+}
+
+// Find bin with maximum count in 3D histogram
+void argmax3D(const cv::Mat& hist, cv::Vec3i& maxIdx, int& maxVal)
+{
+    const int* sizes = hist.size.p;
+    const int bx = sizes[0], by = sizes[1], bz = sizes[2];
+
+    maxVal = std::numeric_limits<int>::min();
+    maxIdx = cv::Vec3i(0, 0, 0);
+
+    for (int x = 0; x < bx; ++x)
+    for (int y = 0; y < by; ++y)
+    for (int z = 0; z < bz; ++z) {
+        int idx[3] = { x, y, z };
+        int v = hist.at<int>(idx);
+        if (v > maxVal) {
+            maxVal = v;
+            maxIdx = cv::Vec3i(x, y, z);
+        }
+    }
+}
+
+// Calculate representative color from bin center
+cv::Vec3i binCenterBGR(const cv::Vec3i& idx, int bucketSize)
+{
+    const int cBlue  = idx[0] * bucketSize + bucketSize / 2;
+    const int cGreen = idx[1] * bucketSize + bucketSize / 2;
+    const int cRed   = idx[2] * bucketSize + bucketSize / 2;
+    return cv::Vec3i(cBlue, cGreen, cRed);
+}
+
+bool parsePrefilter(const std::string& name, Prefilter& pf)
+{
+    if (name == "none")    { pf = Prefilter::None;    return true; }
+    if (name == "median3") { pf = Prefilter::Median3; return true; }
+    if (name == "box3")    { pf = Prefilter::Box3;    return true; }
+    return false;
+}
+
+// Compare-exchange used by the median sorting network
+static inline void sortPair(uchar& a, uchar& b)
+{
+    const uchar lo = std::min(a, b);
+    b = std::max(a, b);
+    a = lo;
+}
+
+#if CV_SIMD
+static inline void sortPair(cv::v_uint8& a, cv::v_uint8& b)
+{
+    const cv::v_uint8 lo = cv::v_min(a, b);
+    b = cv::v_max(a, b);
+    a = lo;
+}
+#endif
+
+// Median of 9 with a 19 compare-exchange sorting network
+// Works on scalars and on SIMD vectors (lane-wise medians)
+template <typename T>
+static inline T median9(T p[9])
+{
+    sortPair(p[1], p[2]); sortPair(p[4], p[5]); sortPair(p[7], p[8]);
+    sortPair(p[0], p[1]); sortPair(p[3], p[4]); sortPair(p[6], p[7]);
+    sortPair(p[1], p[2]); sortPair(p[4], p[5]); sortPair(p[7], p[8]);
+    sortPair(p[0], p[3]); sortPair(p[5], p[8]); sortPair(p[4], p[7]);
+    sortPair(p[3], p[6]); sortPair(p[1], p[4]); sortPair(p[2], p[5]);
+    sortPair(p[4], p[7]); sortPair(p[4], p[2]); sortPair(p[6], p[4]);
+    sortPair(p[4], p[2]);
+    return p[4];
+}
+
+// 3x3 per-channel median of one BGR row from rows above (a), at (b) and below (c)
+// Rows are treated as byte streams: horizontal neighbors of a byte are +-3 bytes away
+// Border columns replicate the edge pixel
+static void median3Row(const uchar* a, const uchar* b, const uchar* c, uchar* dst, int cols)
+{
+    const int n = cols * 3;
+    int i = 0;
+
+    auto scalarAt = [&](int k) {
+        const int col = k / 3, ch = k % 3;
+        const int l = std::max(col - 1, 0) * 3 + ch;
+        const int r = std::min(col + 1, cols - 1) * 3 + ch;
+        uchar p[9] = { a[l], a[k], a[r], b[l], b[k], b[r], c[l], c[k], c[r] };
+        dst[k] = median9(p);
+    };
+
+    for (; i < std::min(3, n); ++i)
+        scalarAt(i);
+
+#if CV_SIMD
+    const int VL = cv::v_uint8::nlanes;
+    for (; i + 3 + VL <= n; i += VL) {
+        cv::v_uint8 p[9] = {
+            cv::vx_load(a + i - 3), cv::vx_load(a + i), cv::vx_load(a + i + 3),
+            cv::vx_load(b + i - 3), cv::vx_load(b + i), cv::vx_load(b + i + 3),
+            cv::vx_load(c + i - 3), cv::vx_load(c + i), cv::vx_load(c + i + 3)
+        };
+        cv::v_store(dst + i, median9(p));
+    }
+#endif
+
+    for (; i < n; ++i)
+        scalarAt(i);
+}
+
+// 3x3 per-channel box average of one BGR row (replicated border columns)
+static void box3Row(const uchar* a, const uchar* b, const uchar* c, uchar* dst,
+                    ushort* colSum, int cols)
+{
+    const int n = cols * 3;
+    for (int i = 0; i < n; ++i)
+        colSum[i] = ushort(a[i] + b[i] + c[i]);
+
+    for (int i = 0; i < n; ++i) {
+        const int l = (i >= 3) ? i - 3 : i;
+        const int r = (i + 3 < n) ? i + 3 : i;
+        dst[i] = uchar((colSum[l] + colSum[i] + colSum[r] + 4) / 9);
+    }
+}
+
+// Denoised copy of row r of fg into dst (fg.cols BGR pixels)
+static inline void prefilterRow(const cv::Mat& fg, int r, Prefilter pf, uchar* dst, ushort* colSum)
+{
+    const uchar* a = fg.ptr<uchar>(std::max(r - 1, 0));
+    const uchar* b = fg.ptr<uchar>(r);
+    const uchar* c = fg.ptr<uchar>(std::min(r + 1, fg.rows - 1));
+
+    if (pf == Prefilter::Median3)
+        median3Row(a, b, c, dst, fg.cols);
+    else
+        box3Row(a, b, c, dst, colSum, fg.cols);
+}
+
+// Key one row: keyRow is compared against cBGR, output takes the background
+// pixel where close and the unfiltered foreground pixel elsewhere
+static inline void keyRowReplace(const cv::Vec3b* keyRow, const cv::Vec3b* frow,
+                                 const cv::Mat& bg, int r, const cv::Vec3i& cBGR, int tol,
+                                 cv::Vec3b* orow, int cols)
+{
+    int br = (bg.rows > 0) ? (r % bg.rows) : 0;
+    const cv::Vec3b* brow = (bg.rows > 0) ? bg.ptr<cv::Vec3b>(br) : nullptr;
+
+    for (int c = 0; c < cols; ++c) {
+        const cv::Vec3b kpx = keyRow[c];
+        const int dB = std::abs(int(kpx[0]) - cBGR[0]);
+        const int dG = std::abs(int(kpx[1]) - cBGR[1]);
+        const int dR = std::abs(int(kpx[2]) - cBGR[2]);
+
+        const bool isClose = (dB <= tol) && (dG <= tol) && (dR <= tol);
+
+        if (isClose && brow != nullptr) {
+            int bc = (bg.cols > 0) ? (c % bg.cols) : 0;
+            orow[c] = brow[bc];
+        } else {
+            orow[c] = frow[c];
+        }
+    }
+}
+
+// Chroma key with a denoising prefilter fused ahead of the key compare
+// Work is split into row strips; each row is filtered into a small row
+// buffer and keyed immediately, so the filtered image is never materialized
+static void chromaReplaceFiltered(const cv::Mat& fg, const cv::Mat& bg, const cv::Vec3i& cBGR,
+                                  int tol, Prefilter pf, cv::Mat& out)
+{
+    out.create(fg.size(), fg.type());
+    const int STRIP_ROWS = 32;
+    const int nStrips = (fg.rows + STRIP_ROWS - 1) / STRIP_ROWS;
+
+    cv::parallel_for_(cv::Range(0, nStrips), [&](const cv::Range& range) {
+        std::vector<cv::Vec3b> filtered(fg.cols);
+        std::vector<ushort> colSum(static_cast<size_t>(fg.cols) * 3);
+        uchar* dst = reinterpret_cast<uchar*>(filtered.data());
+
+        for (int s = range.start; s < range.end; ++s) {
+            const int r0 = s * STRIP_ROWS;
+            const int r1 = std::min(fg.rows, r0 + STRIP_ROWS);
+            for (int r = r0; r < r1; ++r) {
+                prefilterRow(fg, r, pf, dst, colSum.data());
+                keyRowReplace(filtered.data(), fg.ptr<cv::Vec3b>(r), bg, r, cBGR, tol,
+                              out.ptr<cv::Vec3b>(r), fg.cols);
+            }
+        }
+    });
+}
+
+// Perform chroma key replacement
+// Pixels within tolerance of target color are replaced with background pixels
+void chromaReplace(const cv::Mat& fg, const cv::Mat& bg,
+                   const cv::Vec3i& cBGR, int tol, cv::Mat& out,
+                   Prefilter pf)
+{
+    if (pf != Prefilter::None) {
+        chromaReplaceFiltered(fg, bg, cBGR, tol, pf, out);
+        return;
+    }
+
+    out.create(fg.size(), fg.type());
+
+    for (int r = 0; r < fg.rows; ++r) {
+        const cv::Vec3b* frow = fg.ptr<cv::Vec3b>(r);
+        keyRowReplace(frow, frow, bg, r, cBGR, tol, out.ptr<cv::Vec3b>(r), fg.cols);
+    }
+}
+
+// 3D histogram via cv::calcHist, same binning as buildHistogram3D when
+// buckets divides 256 (uniform bins of 256 / buckets)
+cv::Mat buildHistogram3DCalcHist(const cv::Mat& imgBGR, int buckets)
+{
+    const int channels[3] = { 0, 1, 2 };
+    const int histSize[3] = { buckets, buckets, buckets };
+    const float range[2] = { 0.f, 256.f };
+    const float* ranges[3] = { range, range, range };
+
+    cv::Mat hist;
+    cv::calcHist(&imgBGR, 1, channels, cv::Mat(), hist, 3, histSize, ranges, true, false);
+    hist.convertTo(hist, CV_32S);
+    return hist;
+}
+
+// Background wrapped (tiled) to size, matching chromaReplace's modulo indexing
+// Returns bg itself when it already has the requested size
+cv::Mat tileBackground(const cv::Mat& bg, cv::Size size)
+{
+    if (bg.empty() || bg.size() == size)
+        return bg;
+
+    cv::Mat tiled;
+    cv::repeat(bg, (size.height + bg.rows - 1) / bg.rows, (size.width + bg.cols - 1) / bg.cols, tiled);
+    return tiled(cv::Rect(0, 0, size.width, size.height));
+}
+
+// Chroma key via cv::inRange mask and masked copy of the tiled background
+void chromaReplaceInRange(const cv::Mat& fg, const cv::Mat& bg,
+                          const cv::Vec3i& cBGR, int tol, cv::Mat& out)
+{
+    fg.copyTo(out);
+    if (bg.empty())
+        return;
+
+    cv::Mat mask;
+    cv::inRange(fg, cv::Scalar(cBGR[0] - tol, cBGR[1] - tol, cBGR[2] - tol),
+                    cv::Scalar(cBGR[0] + tol, cBGR[1] + tol, cBGR[2] + tol), mask);
+    tileBackground(bg, fg.size()).copyTo(out, mask);
+}
+
+// chromaReplace without prefilter, as a plain kernel pointer
+void chromaReplaceUnfiltered(const cv::Mat& fg, const cv::Mat& bg,
+                             const cv::Vec3i& cBGR, int tol, cv::Mat& out)
+{
+    chromaReplace(fg, bg, cBGR, tol, out);
+}
+
+KeyingKernels builtinKernels()
+{
+    KeyingKernels k;
+    k.histogram = buildHistogram3DCalcHist;
+    k.replace = chromaReplaceInRange;
+    k.histogramName = "builtin";
+    k.replaceName = "builtin";
+    return k;
+}
+
+// Keying with the selected kernels; the denoising prefilter has no built-in
+// equivalent and always runs the fused custom pass
+void keyImage(const KeyingKernels& k, const cv::Mat& fg, const cv::Mat& bg,
+              const cv::Vec3i& cBGR, int tol, Prefilter pf, cv::Mat& out)
+{
+    if (pf != Prefilter::None)
+        chromaReplace(fg, bg, cBGR, tol, out, pf);
+    else
+        k.replace(fg, bg, cBGR, tol, out);
+}
+
+// Time custom and built-in versions of each kernel on this host and input,
+// print the comparison and return the fastest of each
+KeyingKernels benchmarkKernels(const cv::Mat& fg, const cv::Mat& bg, int buckets, int tol)
+{
+    const KeyingKernels custom, builtin = builtinKernels();
+    const cv::Vec3i cBGR(128, 128, 128);
+    const int iterations = 5;
+    cv::Mat out;
+
+    const double histCustom  = bestTimeMs([&] { custom.histogram(fg, buckets); }, iterations);
+    const double histBuiltin = bestTimeMs([&] { builtin.histogram(fg, buckets); }, iterations);
+    const double replCustom  = bestTimeMs([&] { custom.replace(fg, bg, cBGR, tol, out); }, iterations);
+    const double replBuiltin = bestTimeMs([&] { builtin.replace(fg, bg, cBGR, tol, out); }, iterations);
+
+    cout << "Kernel benchmark (" << fg.cols << "x" << fg.rows << ", best of " << iterations << "):\n"
+         << "  histogram: custom " << histCustom << " ms, calcHist " << histBuiltin << " ms\n"
+         << "  replace:   custom " << replCustom << " ms, inRange+copyTo " << replBuiltin << " ms\n";
+
+    KeyingKernels best = custom;
+    if (histBuiltin < histCustom) {
+        best.histogram = builtin.histogram;
+        best.histogramName = builtin.histogramName;
+    }
+    if (replBuiltin < replCustom) {
+        best.replace = builtin.replace;
+        best.replaceName = builtin.replaceName;
+    }
+    return best;
+}
+
+// Identifies the host for the kernel choice cache
+static std::string hostSignature()
+{
+    return cv::getVersionString() + " " + std::to_string(cv::getNumberOfCPUs()) + " cpus " +
+           cv::getCPUFeaturesLine();
+}
+
+// Kernel choice cache: one "signature<TAB>histogram<TAB>replace" line per host
+static bool loadCachedKernels(const std::string& path, KeyingKernels& k)
+{
+    std::ifstream in(path);
+    std::string line;
+    const std::string sig = hostSignature();
+    while (std::getline(in, line)) {
+        const size_t t1 = line.find('\t');
+        const size_t t2 = line.find('\t', t1 == std::string::npos ? t1 : t1 + 1);
+        if (t2 == std::string::npos || line.compare(0, t1, sig) != 0 || t1 != sig.size())
+            continue;
+        const std::string hist = line.substr(t1 + 1, t2 - t1 - 1);
+        const std::string repl = line.substr(t2 + 1);
+        const KeyingKernels builtin = builtinKernels();
+        if (hist == "builtin") { k.histogram = builtin.histogram; k.histogramName = hist; }
+        if (repl == "builtin") { k.replace = builtin.replace; k.replaceName = repl; }
+        return true;
+    }
+    return false;
+}
+
+// Best effort: without a cache path, or when it cannot be written (read-only
+// or shared locations), the choice is simply measured again next run
+static void storeCachedKernels(const std::string& path, const KeyingKernels& k)
+{
+    if (path.empty())
+        return;
+    const size_t slash = path.find_last_of("/\\");
+    if (slash != std::string::npos && slash > 0)
+        cv::utils::fs::createDirectories(path.substr(0, slash));
+    std::ofstream out(path, std::ios::app);
+    out << hostSignature() << "\t" << k.histogramName << "\t" << k.replaceName << "\n";
+}
+
+std::string defaultKernelCachePath()
+{
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    return base && *base ? std::string(base) + "\\opencv-toolkit\\chroma_kernels" : std::string();
+#else
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg)
+        return std::string(xdg) + "/opencv-toolkit/chroma_kernels";
+    const char* home = std::getenv("HOME");
+    return home && *home ? std::string(home) + "/.cache/opencv-toolkit/chroma_kernels" : std::string();
+#endif
+}
+
+// Kernel selection: custom, builtin, bench (always measure) or auto
+// (cached per host, measured on the first run)
+bool selectKernels(const std::string& mode, const std::string& cachePath,
+                   const cv::Mat& fg, const cv::Mat& bg, int buckets, int tol,
+                   KeyingKernels& k)
+{
+    if (mode == "custom") {
+        k = KeyingKernels();
+    } else if (mode == "builtin") {
+        k = builtinKernels();
+    } else if (mode == "bench" || mode == "auto") {
+        k = KeyingKernels();
+        if (mode == "auto" && loadCachedKernels(cachePath, k))
+            return true;
+        k = benchmarkKernels(fg, bg, buckets, tol);
+        storeCachedKernels(cachePath, k);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Build histogram of key distances in one pass
+// Distance is the largest per-channel difference to cBGR, which is exactly
+// what chromaReplace compares against the tolerance; with a prefilter each
+// row is denoised first, as the fused key compare does
+void buildDistanceHistogram(const cv::Mat& imgBGR, const cv::Vec3i& cBGR, int hist[256],
+                            Prefilter pf)
+{
+    std::fill(hist, hist + 256, 0);
+
+    std::vector<cv::Vec3b> filtered(pf != Prefilter::None ? imgBGR.cols : 0);
+    std::vector<ushort> colSum(pf == Prefilter::Box3 ? static_cast<size_t>(imgBGR.cols) * 3 : 0);
+    for (int r = 0; r < imgBGR.rows; ++r) {
+        const cv::Vec3b* row = imgBGR.ptr<cv::Vec3b>(r);
+        if (pf != Prefilter::None) {
+            prefilterRow(imgBGR, r, pf, reinterpret_cast<uchar*>(filtered.data()), colSum.data());
+            row = filtered.data();
+        }
+        for (int c = 0; c < imgBGR.cols; ++c) {
+            const int dB = std::abs(int(row[c][0]) - cBGR[0]);
+            const int dG = std::abs(int(row[c][1]) - cBGR[1]);
+            const int dR = std::abs(int(row[c][2]) - cBGR[2]);
+            hist[std::max(dB, std::max(dG, dR))] += 1;
+        }
+    }
+}
+
+// Otsu threshold over a 256-bin histogram
+// Returns t maximizing between-class variance of [0, t] vs (t, 255]
+int otsuThreshold(const int hist[256])
+{
+    double total = 0.0, sumAll = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        total  += hist[i];
+        sumAll += double(i) * hist[i];
+    }
+    if (total <= 0.0) return 0;
+
+    double w0 = 0.0, sum0 = 0.0, bestVar = -1.0;
+    int best = 0;
+    for (int t = 0; t < 255; ++t) {
+        w0   += hist[t];
+        sum0 += double(t) * hist[t];
+        const double w1 = total - w0;
+        if (w0 <= 0.0) continue;
+        if (w1 <= 0.0) break;
+
+        const double m0 = sum0 / w0;
+        const double m1 = (sumAll - sum0) / w1;
+        const double between = w0 * w1 * (m0 - m1) * (m0 - m1);
+        if (between > bestVar) {
+            bestVar = between;
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Automatic tolerance: keyed pixels form the low-distance class of the
+// key-distance histogram, so the Otsu split between the key cluster and
+// the subject is used as tolerance
+int autoTolerance(const cv::Mat& fg, const cv::Vec3i& cBGR, Prefilter pf)
+{
+    int hist[256];
+    buildDistanceHistogram(fg, cBGR, hist, pf);
+    return otsuThreshold(hist);
+}
+
+// Detect key color as the center of the most populated histogram bin
+cv::Vec3i detectKeyColor(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         cv::Vec3i& maxIdx, int& maxVal)
+{
+    cv::Mat hist = k.histogram(fg, buckets);
+    argmax3D(hist, maxIdx, maxVal);
+    return binCenterBGR(maxIdx, 256 / buckets);
+}
+
+bool parseKeySampling(const std::string& spec, KeySampling& sampling)
+{
+    if (spec == "full")   { sampling.mode = KeySampling::Mode::Full;   return true; }
+    if (spec == "border") { sampling.mode = KeySampling::Mode::Border; return true; }
+
+    int x = 0, y = 0, w = 0, h = 0;
+    char tail = 0;
+    if (std::sscanf(spec.c_str(), "%d,%d,%d,%d%c", &x, &y, &w, &h, &tail) != 4 || w <= 0 || h <= 0)
+        return false;
+    sampling.mode = KeySampling::Mode::Roi;
+    sampling.roi = cv::Rect(x, y, w, h);
+    return true;
+}
+
+// Regions of fg that a sampling mode covers; empty when it degenerates to
+// the full frame (strips as wide as the frame, ROI outside it)
+static std::vector<cv::Rect> sampleRegions(const cv::Mat& fg, const KeySampling& sampling)
+{
+    std::vector<cv::Rect> regions;
+    const int w = fg.cols, h = fg.rows, b = sampling.border;
+    if (sampling.mode == KeySampling::Mode::Border && b > 0 && 2 * b < w && 2 * b < h) {
+        regions.emplace_back(0, 0, w, b);              // top
+        regions.emplace_back(0, h - b, w, b);          // bottom
+        regions.emplace_back(0, b, b, h - 2 * b);      // left, between the corners
+        regions.emplace_back(w - b, b, b, h - 2 * b);  // right
+    } else if (sampling.mode == KeySampling::Mode::Roi) {
+        const cv::Rect roi = sampling.roi & cv::Rect(0, 0, w, h);
+        if (roi.area() > 0)
+            regions.push_back(roi);
+    }
+    return regions;
+}
+
+cv::Mat sampledHistogram(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         const KeySampling& sampling, long long& sampledPixels)
+{
+    const std::vector<cv::Rect> regions = sampleRegions(fg, sampling);
+    if (regions.empty()) {
+        sampledPixels = static_cast<long long>(fg.total());
+        return k.histogram(fg, buckets);
+    }
+
+    // Histograms of the regions (ROIs, no copies) summed into one
+    cv::Mat hist;
+    sampledPixels = 0;
+    for (const cv::Rect& r : regions) {
+        cv::Mat h = k.histogram(fg(r), buckets);
+        if (hist.empty())
+            hist = h;
+        else
+            cv::add(hist, h, hist);
+        sampledPixels += r.area();
+    }
+    return hist;
+}
+
+cv::Vec3i detectKeyColor(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         const KeySampling& sampling, cv::Vec3i& maxIdx, int& maxVal,
+                         bool* usedSample)
+{
+    if (usedSample)
+        *usedSample = false;
+
+    long long sampled = 0;
+    cv::Mat hist = sampledHistogram(k, fg, buckets, sampling, sampled);
+    argmax3D(hist, maxIdx, maxVal);
+    if (sampled < static_cast<long long>(fg.total())) {
+        if (maxVal < sampling.minShare * sampled)
+            return detectKeyColor(k, fg, buckets, maxIdx, maxVal);
+        if (usedSample)
+            *usedSample = true;
+    }
+    return binCenterBGR(maxIdx, 256 / buckets);
+}
+
+// Render one tolerance of the session
+void KeyingSession::render(int tol, cv::Mat& out) const
+{
+    keyImage(kernels, fg, bg, cBGR, clamp(tol, 0, tolMax), prefilter, out);
+}
+
+// Time and compare each approximate mode against the exact path it replaces
+// The keyed plates are compared, so a different key color or a coarse proxy
+// shows up as the pixels it keys differently
+void reportAccuracy(const KeyingSession& session, const KeySampling& sampling,
+                    int buckets, int tol, int iterations)
+{
+    const cv::Mat& fg = session.fg;
+    cv::Mat reference, fast;
+    session.render(tol, reference);
+    printAccuracyHeader(cout, fg.size(), iterations);
+
+    // Sampled key detection: full-frame histogram vs the border strips or ROI
+    // (border strips when no sampling was requested)
+    KeySampling sampled = sampling;
+    if (sampled.mode == KeySampling::Mode::Full)
+        sampled.mode = KeySampling::Mode::Border;
+    const KeySampling full;
+    cv::Vec3i idx;
+    int count = 0;
+    const double detectFullMs = bestTimeMs(
+        [&] { detectKeyColor(session.kernels, fg, buckets, full, idx, count); }, iterations);
+    const double detectSampledMs = bestTimeMs(
+        [&] { detectKeyColor(session.kernels, fg, buckets, sampled, idx, count); }, iterations);
+    KeyingSession sampledSession = session;
+    sampledSession.cBGR = detectKeyColor(session.kernels, fg, buckets, sampled, idx, count);
+    sampledSession.render(tol, fast);
+    ImageError err;
+    compareImages(reference, fast, err);
+    printAccuracyRow(cout, "key detection: sampled", detectFullMs, detectSampledMs, err);
+
+    // Proxy preview: nearest-downscaled plates keyed and scaled back up
+    const double scale = std::min(proxyScale(fg.size()), 0.5);
+    KeyingSession proxy = session;
+    cv::resize(session.fg, proxy.fg, cv::Size(), scale, scale, cv::INTER_NEAREST);
+    cv::resize(session.bg, proxy.bg, proxy.fg.size(), 0, 0, cv::INTER_NEAREST);
+    const double fullMs = bestTimeMs([&] { session.render(tol, fast); }, iterations);
+    const double proxyMs = bestTimeMs([&] { proxy.render(tol, fast); }, iterations);
+    compareImages(reference, upscaleToMatch(fast, fg.size(), true), err);
+    printAccuracyRow(cout, cv::format("proxy render 1/%d", cvRound(1.0 / scale)), fullMs, proxyMs, err);
+
+    // Built-in replace kernel: meant to be exact, so any error here is a bug
+    const KeyingKernels custom, builtin = builtinKernels();
+    const double customMs = bestTimeMs(
+        [&] { custom.replace(fg, session.bg, session.cBGR, tol, fast); }, iterations);
+    const double builtinMs = bestTimeMs(
+        [&] { builtin.replace(fg, session.bg, session.cBGR, tol, fast); }, iterations);
+    cv::Mat customOut;
+    custom.replace(fg, session.bg, session.cBGR, tol, customOut);
+    compareImages(customOut, fast, err);
+    printAccuracyRow(cout, "replace: inRange+copyTo", customMs, builtinMs, err);
+}
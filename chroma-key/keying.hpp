@@ -0,0 +1,153 @@
+// Chroma key compute kernels and keying sessions
+// Nothing here touches highgui or global mutable state: every function works
+// only on its arguments, so kernels and sessions can run on any thread
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <string>
+
+// Clamp value between min and max
+template <typename T>
+inline T clamp(T v, T lo, T hi) {
+    return std::max(lo, std::min(hi, v));
+}
+
+// Build 3D color histogram with manual binning
+// Returns histogram with shape [buckets, buckets, buckets] for B,G,R channels
+cv::Mat buildHistogram3D(const cv::Mat& imgBGR, int buckets);
+
+// 3D histogram via cv::calcHist, same binning as buildHistogram3D when
+// buckets divides 256 (uniform bins of 256 / buckets)
+cv::Mat buildHistogram3DCalcHist(const cv::Mat& imgBGR, int buckets);
+
+// Find bin with maximum count in 3D histogram
+void argmax3D(const cv::Mat& hist, cv::Vec3i& maxIdx, int& maxVal);
+
+// Calculate representative color from bin center
+cv::Vec3i binCenterBGR(const cv::Vec3i& idx, int bucketSize);
+
+// Optional denoising applied to the key decision only
+enum class Prefilter { None, Median3, Box3 };
+
+bool parsePrefilter(const std::string& name, Prefilter& pf);
+
+// Perform chroma key replacement
+// Pixels within tolerance of target color are replaced with background pixels
+// With a prefilter, the key compare runs on the denoised image (fused per row)
+// while unkeyed pixels keep the original foreground
+void chromaReplace(const cv::Mat& fg, const cv::Mat& bg,
+                   const cv::Vec3i& cBGR, int tol, cv::Mat& out,
+                   Prefilter pf = Prefilter::None);
+
+// chromaReplace without prefilter, as a plain kernel pointer
+void chromaReplaceUnfiltered(const cv::Mat& fg, const cv::Mat& bg,
+                             const cv::Vec3i& cBGR, int tol, cv::Mat& out);
+
+// Chroma key via cv::inRange mask and masked copy of the tiled background
+void chromaReplaceInRange(const cv::Mat& fg, const cv::Mat& bg,
+                          const cv::Vec3i& cBGR, int tol, cv::Mat& out);
+
+// Background wrapped (tiled) to size, matching chromaReplace's modulo indexing
+// Returns bg itself when it already has the requested size
+cv::Mat tileBackground(const cv::Mat& bg, cv::Size size);
+
+// Interchangeable implementations of the two hot kernels
+// Custom ones are the manual loops, built-in ones use OpenCV primitives
+struct KeyingKernels {
+    cv::Mat (*histogram)(const cv::Mat& imgBGR, int buckets) = buildHistogram3D;
+    void (*replace)(const cv::Mat& fg, const cv::Mat& bg, const cv::Vec3i& cBGR,
+                    int tol, cv::Mat& out) = chromaReplaceUnfiltered;
+    std::string histogramName = "custom";
+    std::string replaceName = "custom";
+};
+
+KeyingKernels builtinKernels();
+
+// Keying with the selected kernels; the denoising prefilter has no built-in
+// equivalent and always runs the fused custom pass
+void keyImage(const KeyingKernels& k, const cv::Mat& fg, const cv::Mat& bg,
+              const cv::Vec3i& cBGR, int tol, Prefilter pf, cv::Mat& out);
+
+// Time custom and built-in versions of each kernel on this host and input,
+// print the comparison and return the fastest of each
+KeyingKernels benchmarkKernels(const cv::Mat& fg, const cv::Mat& bg, int buckets, int tol);
+
+// Kernel selection: custom, builtin, bench (always measure) or auto
+// (cached per host in cachePath, measured on the first run; an empty or
+// unwritable cachePath only costs the measurement again)
+// Returns false for an unknown mode
+// Per-user location of the kernel choice cache: $XDG_CACHE_HOME (or
+// ~/.cache) /opencv-toolkit/chroma_kernels; empty when no home is known
+std::string defaultKernelCachePath();
+
+bool selectKernels(const std::string& mode, const std::string& cachePath,
+                   const cv::Mat& fg, const cv::Mat& bg, int buckets, int tol,
+                   KeyingKernels& k);
+
+// Build histogram of key distances in one pass
+// Distance is the largest per-channel difference to cBGR, which is exactly
+// what chromaReplace compares against the tolerance, on the prefiltered
+// pixels when the compare uses a prefilter
+void buildDistanceHistogram(const cv::Mat& imgBGR, const cv::Vec3i& cBGR, int hist[256],
+                            Prefilter pf = Prefilter::None);
+
+// Otsu threshold over a 256-bin histogram
+// Returns t maximizing between-class variance of [0, t] vs (t, 255]
+int otsuThreshold(const int hist[256]);
+
+// Automatic tolerance: keyed pixels form the low-distance class of the
+// key-distance histogram, so the Otsu split between the key cluster and
+// the subject is used as tolerance
+int autoTolerance(const cv::Mat& fg, const cv::Vec3i& cBGR, Prefilter pf = Prefilter::None);
+
+// Detect key color as the center of the most populated histogram bin
+cv::Vec3i detectKeyColor(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         cv::Vec3i& maxIdx, int& maxVal);
+
+// Part of the foreground that key detection histograms
+// Border: strips of `border` pixels along the four frame edges, where the
+// screen usually is; Roi: a user rectangle. Either costs in proportion to the
+// sampled area instead of the whole frame.
+struct KeySampling {
+    enum class Mode { Full, Border, Roi };
+    Mode mode = Mode::Full;
+    int border = 32;
+    cv::Rect roi;
+    double minShare = 0.5;  // share of sampled pixels the top bin needs to be trusted
+};
+
+// Parse "full", "border" or an ROI given as "x,y,w,h"
+bool parseKeySampling(const std::string& spec, KeySampling& sampling);
+
+// Histogram of the sampled part of fg (all of it for Full, or when the
+// sampling covers nothing); sampledPixels receives the pixels counted
+cv::Mat sampledHistogram(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         const KeySampling& sampling, long long& sampledPixels);
+
+// Detect key color from the sampled part of the foreground; falls back to the
+// full frame when no bin holds minShare of the sample. usedSample tells which
+// one decided (maxVal then counts pixels of that region).
+cv::Vec3i detectKeyColor(const KeyingKernels& k, const cv::Mat& fg, int buckets,
+                         const KeySampling& sampling, cv::Vec3i& maxIdx, int& maxVal,
+                         bool* usedSample = nullptr);
+
+// Compute state of one keying session: prepared inputs and settings, no UI
+// render() only reads the session, so one session may render from several
+// threads and any number of sessions can run side by side
+struct KeyingSession {
+    cv::Mat fg;
+    cv::Mat bg;  // tiled to the foreground size
+    cv::Vec3i cBGR;
+    int tolMax = 255;
+    Prefilter prefilter = Prefilter::None;
+    KeyingKernels kernels;
+
+    void render(int tol, cv::Mat& out) const;
+};
+
+// Accuracy-versus-speed report of the approximate modes (sampled key
+// detection, proxy preview, built-in replace kernel) on this session's plates
+void reportAccuracy(const KeyingSession& session, const KeySampling& sampling,
+                    int buckets, int tol, int iterations);
@@ -0,0 +1,15 @@
+// Image decode off the calling thread
+// Startup decodes its inputs concurrently (and next to other setup work)
+// instead of one after another
+
+#pragma once
+
+#include <opencv2/imgcodecs.hpp>
+#include <future>
+#include <string>
+
+// Decode an image on a worker thread
+inline std::future<cv::Mat> decodeAsync(const std::string& path, int flags = cv::IMREAD_COLOR)
+{
+    return std::async(std::launch::async, [path, flags] { return cv::imread(path, flags); });
+}
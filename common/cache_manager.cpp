@@ -0,0 +1,227 @@
+// Central result cache with one byte budget for every cache in the process
+
+#include "cache_manager.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Caches and keys share one map; '\n' never appears in either
+std::string fullKey(const std::string& cache, const std::string& key)
+{
+    return cache + '\n' + key;
+}
+
+} // namespace
+
+CacheManager::CacheManager(size_t budgetBytes)
+    : budget_(budgetBytes)
+{
+}
+
+CacheManager& CacheManager::shared()
+{
+    static CacheManager instance;
+    return instance;
+}
+
+void CacheManager::setBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budgetBytes;
+    evictTo(budget_);
+}
+
+size_t CacheManager::budget() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+double CacheManager::priority(const Entry& e) const
+{
+    // Recompute milliseconds saved per MiB held; the small floor keeps
+    // near-free entries ordered by size instead of all tying at zero
+    const double mib = std::max(e.bytes, size_t(1)) / double(1 << 20);
+    return inflation_ + e.uses * std::max(e.costMs, 1e-3) / mib;
+}
+
+void CacheManager::touch(const std::string& key, Entry& e)
+{
+    queue_.erase(e.queuePos);
+    e.queuePos = queue_.emplace(priority(e), key);
+}
+
+void CacheManager::remove(std::unordered_map<std::string, Entry>::iterator it)
+{
+    Stats& s = stats_[it->second.cache];
+    s.entries--;
+    s.bytes -= it->second.bytes;
+    s.rawBytes -= it->second.rawBytes;
+    bytes_ -= it->second.bytes;
+    queue_.erase(it->second.queuePos);
+    entries_.erase(it);
+}
+
+void CacheManager::evictTo(size_t bytes)
+{
+    while (bytes_ > bytes && !queue_.empty()) {
+        auto victim = entries_.find(queue_.begin()->second);
+        inflation_ = queue_.begin()->first;
+        stats_[victim->second.cache].evictions++;
+        remove(victim);
+    }
+}
+
+void CacheManager::setCompressed(const std::string& cache, bool compressed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (compressed)
+        compressed_.insert(cache);
+    else
+        compressed_.erase(cache);
+}
+
+bool CacheManager::get(const std::string& cache, const std::string& key, cv::Mat& value)
+{
+    std::shared_ptr<const PackedMat> packed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::string k = fullKey(cache, key);
+        auto it = entries_.find(k);
+        if (it == entries_.end()) {
+            stats_[cache].misses++;
+            return false;
+        }
+        stats_[cache].hits++;
+        it->second.uses++;
+        touch(k, it->second);
+        packed = it->second.value;
+    }
+    // Decoding runs unlocked; the entry stays alive through the shared pointer
+    cv::Mat unpacked = unpackMat(*packed);
+    if (unpacked.empty() && packed->rows * packed->cols > 0) {
+        // Corrupt entry: drop it and report a miss, so the caller recomputes
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_[cache].hits--;
+        stats_[cache].misses++;
+        auto it = entries_.find(fullKey(cache, key));
+        if (it != entries_.end() && it->second.value == packed)
+            remove(it);
+        return false;
+    }
+    value = unpacked;
+    return true;
+}
+
+bool CacheManager::contains(const std::string& cache, const std::string& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(fullKey(cache, key)) != 0;
+}
+
+void CacheManager::put(const std::string& cache, const std::string& key, const cv::Mat& value, double costMs)
+{
+    bool compress;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compress = compressed_.count(cache) != 0;
+    }
+    // Packing runs unlocked, so other threads keep hitting the cache meanwhile
+    auto packed = std::make_shared<PackedMat>();
+    if (compress) {
+        *packed = packMat(value);
+    } else {
+        packed->rows = value.rows;
+        packed->cols = value.cols;
+        packed->type = value.type();
+        packed->raw = value;
+    }
+    const size_t rawBytes = value.total() * value.elemSize();
+    const size_t bytes = packed->size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes > budget_)
+        return;
+
+    const std::string k = fullKey(cache, key);
+    auto old = entries_.find(k);
+    if (old != entries_.end())
+        remove(old);
+
+    evictTo(budget_ - bytes);
+
+    Entry& e = entries_[k];
+    e.value  = packed;
+    e.cache  = cache;
+    e.bytes  = bytes;
+    e.rawBytes = rawBytes;
+    e.costMs = costMs;
+    e.uses   = 1;
+    e.queuePos = queue_.emplace(priority(e), k);
+
+    Stats& s = stats_[cache];
+    s.entries++;
+    s.bytes += bytes;
+    s.rawBytes += rawBytes;
+    bytes_ += bytes;
+}
+
+cv::Mat CacheManager::getOrCompute(const std::string& cache, const std::string& key,
+                                   const std::function<cv::Mat()>& compute)
+{
+    cv::Mat value;
+    if (get(cache, key, value))
+        return value;
+
+    const int64 t0 = cv::getTickCount();
+    value = compute();
+    put(cache, key, value, (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency());
+    return value;
+}
+
+void CacheManager::clear(const std::string& cache)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto next = std::next(it);
+        if (it->second.cache == cache)
+            remove(it);
+        it = next;
+    }
+}
+
+CacheManager::Stats CacheManager::stats(const std::string& cache) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = stats_.find(cache);
+    return it == stats_.end() ? Stats() : it->second;
+}
+
+CacheManager::Stats CacheManager::total() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats t;
+    for (const auto& s : stats_) {
+        t.hits      += s.second.hits;
+        t.misses    += s.second.misses;
+        t.evictions += s.second.evictions;
+        t.entries   += s.second.entries;
+        t.bytes     += s.second.bytes;
+        t.rawBytes  += s.second.rawBytes;
+    }
+    return t;
+}
+
+void CacheManager::printStats(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& s : stats_) {
+        out << "  cache " << s.first << ": " << s.second.hits << " hits, " << s.second.misses
+            << " misses, " << s.second.evictions << " evictions, " << s.second.entries
+            << " entries (" << (s.second.bytes >> 20) << " of " << (budget_ >> 20) << " MB budget";
+        if (s.second.rawBytes != s.second.bytes)
+            out << ", " << (s.second.rawBytes >> 20) << " MB uncompressed";
+        out << ")\n";
+    }
+}
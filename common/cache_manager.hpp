@@ -0,0 +1,100 @@
+// Central result cache with one byte budget for every cache in the process
+// Caches (pyramid tiles, prepared backgrounds, filter results, ...) are named
+// namespaces in one store. Eviction is cost-aware across all of them
+// (GreedyDual-Size-Frequency): an entry's priority is the time it took to
+// compute, times how often it was used, per MiB it occupies, plus an aging
+// term, so cheap/large/cold entries go first whichever cache they belong to.
+// Caches can opt into compressed storage (see mat_codec.hpp): entries are
+// packed on put and unpacked on get, and the budget counts packed bytes.
+
+#pragma once
+
+#include "mat_codec.hpp"
+
+#include <opencv2/core.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+class CacheManager
+{
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;     // held, after compression
+        size_t rawBytes = 0;  // the same entries uncompressed
+    };
+
+    explicit CacheManager(size_t budgetBytes = size_t(512) << 20);
+
+    CacheManager(const CacheManager&) = delete;
+    CacheManager& operator=(const CacheManager&) = delete;
+
+    // Process-wide instance shared by all caches of a tool
+    static CacheManager& shared();
+
+    // Lower budgets evict immediately
+    void setBudget(size_t budgetBytes);
+    size_t budget() const;
+
+    // Store entries of cache compressed from now on
+    void setCompressed(const std::string& cache, bool compressed);
+
+    // Cached value of key in cache; the data of uncompressed entries is shared,
+    // callers must not write to it
+    bool get(const std::string& cache, const std::string& key, cv::Mat& value);
+
+    // Whether key is cached, without counting a hit or miss
+    bool contains(const std::string& cache, const std::string& key) const;
+
+    // Store value with the time it took to compute; values larger than the
+    // whole budget are not cached. Thread-safe, as is every other method.
+    void put(const std::string& cache, const std::string& key, const cv::Mat& value, double costMs);
+
+    // Cached value, or compute() timed and stored; compute runs unlocked, so
+    // two threads missing the same key may both compute it
+    cv::Mat getOrCompute(const std::string& cache, const std::string& key,
+                         const std::function<cv::Mat()>& compute);
+
+    // Drop every entry of cache (statistics are kept)
+    void clear(const std::string& cache);
+
+    Stats stats(const std::string& cache) const;
+    Stats total() const;
+
+    // One line per cache that has seen any traffic
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Entry {
+        std::shared_ptr<const PackedMat> value;
+        std::string cache;
+        size_t bytes;
+        size_t rawBytes;
+        double costMs;
+        size_t uses;
+        std::multimap<double, std::string>::iterator queuePos;
+    };
+
+    double priority(const Entry& e) const;
+    void touch(const std::string& fullKey, Entry& e);
+    void evictTo(size_t bytes);
+    void remove(std::unordered_map<std::string, Entry>::iterator it);
+
+    mutable std::mutex mutex_;
+    size_t budget_;
+    size_t bytes_ = 0;
+    double inflation_ = 0.0;  // priority of the last victim, ages entries not used since
+    std::unordered_map<std::string, Entry> entries_;
+    std::multimap<double, std::string> queue_;  // eviction order, lowest priority first
+    std::map<std::string, Stats> stats_;
+    std::set<std::string> compressed_;
+};
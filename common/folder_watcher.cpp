@@ -0,0 +1,245 @@
+// Watch-folder input for long-lived batch processes
+
+#include "folder_watcher.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool FolderWatcher::supported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef __linux__
+FolderWatcher::FolderWatcher(const std::string& pattern)
+{
+    struct stat st;
+    if (::stat(pattern.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        dir_ = pattern;
+        namePattern_ = "*";
+    } else {
+        const size_t slash = pattern.find_last_of('/');
+        dir_ = slash == std::string::npos ? "." : slash == 0 ? "/" : pattern.substr(0, slash);
+        namePattern_ = slash == std::string::npos ? pattern : pattern.substr(slash + 1);
+    }
+
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0)
+        return;
+    if (inotify_add_watch(fd_, dir_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR) < 0) {
+        ::close(fd_);
+        fd_ = -1;
+        return;
+    }
+
+    // Files present before the watch are not arrivals
+    std::vector<std::string> present;
+    rescan(present);
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool FolderWatcher::watches(const std::string& path) const
+{
+    char a[PATH_MAX], b[PATH_MAX];
+    return ::realpath(dir_.c_str(), a) && ::realpath(path.c_str(), b) &&
+           std::string(a) == std::string(b);
+}
+
+// Shell-style match; wildcards skip dot files (partial uploads, editor temps)
+bool FolderWatcher::matches(const std::string& name) const
+{
+    return fnmatch(namePattern_.c_str(), name.c_str(), FNM_PERIOD) == 0;
+}
+
+// Report matching files not seen before; afterwards seen_ is exactly the
+// directory's matching files, which also forgets any removal events missed
+void FolderWatcher::rescan(std::vector<std::string>& arrived)
+{
+    DIR* d = ::opendir(dir_.c_str());
+    if (!d)
+        return;
+    std::set<std::string> present;
+    while (const dirent* e = ::readdir(d)) {
+        const std::string name = e->d_name;
+        if (e->d_type == DT_DIR || !matches(name))
+            continue;
+        present.insert(name);
+        if (!seen_.count(name))
+            arrived.push_back(dir_ + "/" + name);
+    }
+    ::closedir(d);
+    seen_.swap(present);
+}
+
+std::vector<std::string> FolderWatcher::wait(int timeoutMs)
+{
+    std::vector<std::string> arrived;
+    if (fd_ < 0)
+        return arrived;
+
+    pollfd pfd = { fd_, POLLIN, 0 };
+    if (::poll(&pfd, 1, timeoutMs) <= 0)
+        return arrived;
+
+    bool overflow = false;
+    alignas(inotify_event) char buf[64 * 1024];
+    for (;;) {
+        const ssize_t n = ::read(fd_, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        for (const char* p = buf; p < buf + n;) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            if ((ev->mask & IN_ISDIR) || ev->len == 0)
+                continue;
+            const std::string name = ev->name;
+            if (!matches(name))
+                continue;
+            // Removed names are forgotten, so a later file of that name
+            // arrives again (also when found by a rescan)
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                seen_.erase(name);
+                continue;
+            }
+            // A rewrite of a known name is a new arrival
+            seen_.insert(name);
+            arrived.push_back(dir_ + "/" + name);
+        }
+    }
+    if (overflow)
+        rescan(arrived);
+    return arrived;
+}
+#else
+// Without inotify the watcher never opens; callers check supported() first
+FolderWatcher::FolderWatcher(const std::string& pattern)
+    : dir_(pattern)
+{
+}
+
+FolderWatcher::~FolderWatcher() = default;
+
+bool FolderWatcher::watches(const std::string&) const
+{
+    return false;
+}
+
+bool FolderWatcher::matches(const std::string&) const
+{
+    return false;
+}
+
+void FolderWatcher::rescan(std::vector<std::string>&)
+{
+}
+
+std::vector<std::string> FolderWatcher::wait(int)
+{
+    return {};
+}
+#endif
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void onStopSignal(int)
+{
+    stopRequested = 1;
+}
+
+} // namespace
+
+size_t runWatchLoop(FolderWatcher& watcher, int jobs,
+                    const std::function<void(const std::string&)>& process,
+                    const std::function<void()>& idle)
+{
+    stopRequested = 0;
+#ifdef __linux__
+    // No SA_RESTART: a signal ends the watcher's poll right away
+    struct sigaction sa = {};
+    sa.sa_handler = onStopSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+#else
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+#endif
+
+    jobs = std::max(jobs, 1);
+    std::deque<std::string> pending;
+    std::mutex mutex;
+    std::condition_variable slotFree;
+    int inFlight = 0;
+    bool busy = false;  // files dispatched since the last idle()
+
+    {
+        ThreadPool pool(jobs);
+        while (!stopRequested) {
+            // Block on the watcher only while every arrival is dispatched
+            for (std::string& path : watcher.wait(pending.empty() ? 250 : 0))
+                pending.push_back(std::move(path));
+
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!pending.empty() && inFlight < jobs) {
+                ++inFlight;
+                busy = true;
+                pool.submit([&, path = pending.front()] {
+                    try {
+                        process(path);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Warning: Failed to process '" << path << "': " << e.what() << "\n";
+                    }
+                    std::lock_guard<std::mutex> done(mutex);
+                    --inFlight;
+                    slotFree.notify_one();
+                });
+                pending.pop_front();
+            }
+
+            if (!pending.empty()) {
+                slotFree.wait_for(lock, std::chrono::milliseconds(250), [&] { return inFlight < jobs; });
+            } else if (busy && inFlight == 0) {
+                busy = false;
+                lock.unlock();
+                idle();
+            }
+        }
+        // Leaving the scope finishes the files in flight
+    }
+    if (busy)
+        idle();
+    return pending.size();
+}
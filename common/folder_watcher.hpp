@@ -0,0 +1,59 @@
+// Watch-folder input for long-lived batch processes
+// Instead of a process per file, a tool keeps its thread pool, prepared
+// inputs and caches warm and is fed the files that arrive in a directory.
+// A file counts as arrived once it is complete: written and closed in place
+// (IN_CLOSE_WRITE) or renamed into the directory (IN_MOVED_TO, how most
+// ingest tools publish atomically). Linux only (inotify): elsewhere the file
+// still builds, supported() is false and no watcher opens.
+
+#pragma once
+
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+class FolderWatcher
+{
+public:
+    // pattern is a directory or a glob like the batch modes take
+    // ("plates/*.jpg": watch plates/ for names matching *.jpg); files already
+    // there are not reported
+    explicit FolderWatcher(const std::string& pattern);
+    ~FolderWatcher();
+
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    // Whether this platform can watch directories at all
+    static bool supported();
+
+    bool isOpen() const { return fd_ >= 0; }
+    const std::string& dir() const { return dir_; }
+
+    // Whether path names the watched directory (an output directory that
+    // does would feed the tool its own results)
+    bool watches(const std::string& path) const;
+
+    // Paths of files that arrived, waiting up to timeoutMs for the first one
+    // If the kernel dropped events, the directory is rescanned instead, so
+    // no arrival is missed or reported twice
+    std::vector<std::string> wait(int timeoutMs);
+
+private:
+    bool matches(const std::string& name) const;
+    void rescan(std::vector<std::string>& arrived);
+
+    std::string dir_;
+    std::string namePattern_;
+    int fd_ = -1;
+    std::set<std::string> seen_;  // matching names currently in the directory
+};
+
+// Run process(path) on `jobs` workers for every file the watcher reports,
+// with at most `jobs` files in flight (arrivals beyond that wait in order),
+// until SIGINT or SIGTERM. idle() runs on this thread whenever the files
+// seen so far are all done. Returns the number of arrivals left unprocessed.
+size_t runWatchLoop(FolderWatcher& watcher, int jobs,
+                    const std::function<void(const std::string&)>& process,
+                    const std::function<void()>& idle);
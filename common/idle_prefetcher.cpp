@@ -0,0 +1,79 @@
+// Idle-time speculative precomputation
+
+#include "idle_prefetcher.hpp"
+
+#include <opencv2/core.hpp>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+IdlePrefetcher::IdlePrefetcher()
+    : worker_([this] { workerLoop(); })
+{
+}
+
+IdlePrefetcher::~IdlePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    wake_.notify_all();
+    worker_.join();
+}
+
+void IdlePrefetcher::schedule(std::vector<Task> tasks)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.assign(std::make_move_iterator(tasks.begin()), std::make_move_iterator(tasks.end()));
+    }
+    wake_.notify_one();
+}
+
+void IdlePrefetcher::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+}
+
+void IdlePrefetcher::workerLoop()
+{
+#ifdef __linux__
+    // Linux applies nice values per thread; speculative work yields to the UI
+    // thread and to any real computation
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+                return;
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+        ++completed_;
+    }
+}
+
+void IdleTimer::changed()
+{
+    lastChange_ = cv::getTickCount();
+    fired_ = false;
+}
+
+bool IdleTimer::idleFor(double ms)
+{
+    if (fired_ || (cv::getTickCount() - lastChange_) * 1000.0 / cv::getTickFrequency() < ms)
+        return false;
+    fired_ = true;
+    return true;
+}
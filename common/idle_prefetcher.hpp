@@ -0,0 +1,63 @@
+// Idle-time speculative precomputation
+// While the user rests on a slider value, results for neighboring values are
+// computed on one low-priority background thread and stored in the result
+// cache, so the next small slider move is a cache hit. Any real change cancels
+// the pending work at once: the queue is dropped, and only a task already
+// running (one slider value) finishes.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class IdlePrefetcher
+{
+public:
+    using Task = std::function<void()>;
+
+    IdlePrefetcher();
+    ~IdlePrefetcher();
+
+    IdlePrefetcher(const IdlePrefetcher&) = delete;
+    IdlePrefetcher& operator=(const IdlePrefetcher&) = delete;
+
+    // Replace all pending work with tasks, run in the given order (nearest
+    // neighbors first)
+    void schedule(std::vector<Task> tasks);
+
+    // Drop pending work; a task already running finishes but nothing after it
+    void cancel();
+
+    size_t completed() const { return completed_; }
+
+private:
+    void workerLoop();
+
+    std::thread worker_;
+    std::deque<Task> queue_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> completed_{ 0 };
+    bool stopping_ = false;
+};
+
+// Idle detection for a UI control: call changed() from its callback and
+// idleFor() from the event loop; becomes due once per pause
+class IdleTimer
+{
+public:
+    void changed();
+
+    // True once when no change happened for at least ms milliseconds
+    bool idleFor(double ms);
+
+private:
+    int64_t lastChange_ = 0;
+    bool fired_ = true;
+};
@@ -0,0 +1,196 @@
+// Error metrics and timing for comparing an approximate stage to its reference
+
+#include "image_metrics.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int STRIP_ROWS = 64;
+
+// Per-strip partial sums, combined after the parallel pass
+struct StripSums {
+    long long sse = 0;
+    long long mismatched = 0;
+    double ssim = 0.0;
+};
+
+int stripCount(int rows)
+{
+    return (rows + STRIP_ROWS - 1) / STRIP_ROWS;
+}
+
+// Squared error and differing pixels of rows [r0, r1)
+void errorSums(const cv::Mat& a, const cv::Mat& b, int r0, int r1, StripSums& sums)
+{
+    const int cn = a.channels();
+    const int width = a.cols * cn;
+    for (int r = r0; r < r1; ++r) {
+        const uchar* pa = a.ptr<uchar>(r);
+        const uchar* pb = b.ptr<uchar>(r);
+
+        long long sse = 0;
+        for (int i = 0; i < width; ++i) {
+            const int d = int(pa[i]) - int(pb[i]);
+            sse += d * d;
+        }
+
+        long long mismatched = 0;
+        if (cn == 1) {
+            for (int c = 0; c < a.cols; ++c)
+                mismatched += pa[c] != pb[c];
+        } else {
+            for (int c = 0; c < a.cols; ++c) {
+                int diff = 0;
+                for (int k = 0; k < cn; ++k)
+                    diff |= pa[c * cn + k] ^ pb[c * cn + k];
+                mismatched += diff != 0;
+            }
+        }
+
+        sums.sse += sse;
+        sums.mismatched += mismatched;
+    }
+}
+
+// Sum of the SSIM map over rows [r0, r1) from the Gaussian-weighted moments
+void ssimSum(const cv::Mat& mu1, const cv::Mat& mu2, const cv::Mat& s11, const cv::Mat& s22,
+             const cv::Mat& s12, int r0, int r1, StripSums& sums)
+{
+    // Stabilizers of Wang et al. for 8-bit data: (0.01 * 255)^2, (0.03 * 255)^2
+    const float C1 = 6.5025f, C2 = 58.5225f;
+    const int width = mu1.cols * mu1.channels();
+    for (int r = r0; r < r1; ++r) {
+        const float* m1 = mu1.ptr<float>(r);
+        const float* m2 = mu2.ptr<float>(r);
+        const float* e11 = s11.ptr<float>(r);
+        const float* e22 = s22.ptr<float>(r);
+        const float* e12 = s12.ptr<float>(r);
+
+        float rowSum = 0.0f;
+        for (int i = 0; i < width; ++i) {
+            const float m11 = m1[i] * m1[i], m22 = m2[i] * m2[i], m12 = m1[i] * m2[i];
+            const float v1 = e11[i] - m11, v2 = e22[i] - m22, cov = e12[i] - m12;
+            rowSum += ((2.0f * m12 + C1) * (2.0f * cov + C2)) /
+                      ((m11 + m22 + C1) * (v1 + v2 + C2));
+        }
+        sums.ssim += rowSum;
+    }
+}
+
+// Gaussian-weighted local mean (11x11, sigma 1.5) as in the SSIM paper
+cv::Mat localMean(const cv::Mat& m)
+{
+    cv::Mat mean;
+    cv::GaussianBlur(m, mean, cv::Size(11, 11), 1.5);
+    return mean;
+}
+
+} // namespace
+
+bool compareImages(const cv::Mat& reference, const cv::Mat& test, ImageError& err)
+{
+    if (reference.empty() || reference.size() != test.size() || reference.type() != test.type() ||
+        reference.depth() != CV_8U)
+        return false;
+
+    const int nStrips = stripCount(reference.rows);
+    std::vector<StripSums> strips(nStrips);
+
+    cv::Mat I1, I2, I11, I22, I12;
+    reference.convertTo(I1, CV_32F);
+    test.convertTo(I2, CV_32F);
+    cv::multiply(I1, I1, I11);
+    cv::multiply(I2, I2, I22);
+    cv::multiply(I1, I2, I12);
+    const cv::Mat mu1 = localMean(I1), mu2 = localMean(I2);
+    const cv::Mat s11 = localMean(I11), s22 = localMean(I22), s12 = localMean(I12);
+
+    cv::parallel_for_(cv::Range(0, nStrips), [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; ++s) {
+            const int r0 = s * STRIP_ROWS;
+            const int r1 = std::min(reference.rows, r0 + STRIP_ROWS);
+            errorSums(reference, test, r0, r1, strips[s]);
+            ssimSum(mu1, mu2, s11, s22, s12, r0, r1, strips[s]);
+        }
+    });
+
+    StripSums total;
+    for (const StripSums& s : strips) {
+        total.sse += s.sse;
+        total.mismatched += s.mismatched;
+        total.ssim += s.ssim;
+    }
+
+    const double pixels = double(reference.total());
+    const double samples = pixels * reference.channels();
+    const double mse = total.sse / samples;
+    err.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse)
+                         : std::numeric_limits<double>::infinity();
+    err.ssim = total.ssim / samples;
+    err.mismatch = 100.0 * total.mismatched / pixels;
+    return true;
+}
+
+cv::Mat upscaleToMatch(const cv::Mat& proxy, cv::Size size, bool nearest)
+{
+    if (proxy.size() == size)
+        return proxy;
+    cv::Mat full;
+    cv::resize(proxy, full, size, 0, 0, nearest ? cv::INTER_NEAREST : cv::INTER_LINEAR);
+    return full;
+}
+
+double processStartupMs()
+{
+#ifdef __linux__
+    // Field 22 of /proc/self/stat is the start time in ticks since boot; the
+    // command name (field 2) may contain spaces, so parse after its ')'
+    std::ifstream stat("/proc/self/stat");
+    std::string line;
+    if (!std::getline(stat, line) || line.rfind(')') == std::string::npos)
+        return -1.0;
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    for (int i = 3; i < 22; ++i)
+        fields >> field;
+    unsigned long long startTicks = 0;
+    if (!(fields >> startTicks))
+        return -1.0;
+
+    timespec now;
+    if (clock_gettime(CLOCK_BOOTTIME, &now) != 0)
+        return -1.0;
+    const double startMs = startTicks * 1000.0 / sysconf(_SC_CLK_TCK);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6 - startMs;
+#else
+    return -1.0;
+#endif
+}
+
+void printAccuracyHeader(std::ostream& out, cv::Size size, int iterations)
+{
+    out << "Accuracy vs speed (" << size.width << "x" << size.height
+        << ", best of " << iterations << "):\n"
+        << cv::format("  %-24s %9s %9s %8s %8s %7s %9s\n",
+                      "stage", "ref ms", "fast ms", "speedup", "PSNR dB", "SSIM", "mismatch");
+}
+
+void printAccuracyRow(std::ostream& out, const std::string& stage,
+                      double referenceMs, double fastMs, const ImageError& err)
+{
+    const std::string psnr = std::isinf(err.psnr) ? "inf" : cv::format("%.2f", err.psnr);
+    out << cv::format("  %-24s %9.2f %9.2f %7.1fx %8s %7.4f %8.3f%%\n",
+                      stage.c_str(), referenceMs, fastMs,
+                      fastMs > 0.0 ? referenceMs / fastMs : 0.0,
+                      psnr.c_str(), err.ssim, err.mismatch);
+}
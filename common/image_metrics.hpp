@@ -0,0 +1,52 @@
+// Error metrics and timing for comparing an approximate stage to its reference
+// Both programs use these to report what a fast mode (sampled histograms,
+// proxy renders, grayscale decode, ...) costs in accuracy next to the time it
+// saves. Reductions run over row strips in parallel with branch-free inner
+// loops the compiler vectorizes; SSIM uses OpenCV's vectorized filters.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <string>
+
+struct ImageError {
+    double psnr = 0.0;      // dB over all channels; infinity for identical images
+    double ssim = 0.0;      // mean SSIM over all channels (1 = identical)
+    double mismatch = 0.0;  // percentage of pixels differing in any channel
+};
+
+// Compare test against reference; both 8-bit with the same size and channel
+// count. Returns false (err untouched) when they are not comparable.
+bool compareImages(const cv::Mat& reference, const cv::Mat& test, ImageError& err);
+
+// Bring a proxy-scale result back to the reference size for comparison:
+// nearest neighbor for masks and keyed plates, linear for continuous tones
+cv::Mat upscaleToMatch(const cv::Mat& proxy, cv::Size size, bool nearest);
+
+// Best of several runs in milliseconds
+template <typename F>
+double bestTimeMs(F&& run, int iterations)
+{
+    run();  // warm-up
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < iterations; ++i) {
+        const int64 t0 = cv::getTickCount();
+        run();
+        best = std::min(best, (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency());
+    }
+    return best;
+}
+
+// Milliseconds from process start until now: called first thing in main, the
+// cost of loading and initializing the linked libraries (what the headless
+// builds save). Linux only, at clock-tick resolution (usually 10 ms); -1
+// elsewhere.
+double processStartupMs();
+
+// Accuracy-versus-speed table: a header, then one row per compared stage
+void printAccuracyHeader(std::ostream& out, cv::Size size, int iterations);
+void printAccuracyRow(std::ostream& out, const std::string& stage,
+                      double referenceMs, double fastMs, const ImageError& err);
@@ -0,0 +1,162 @@
+// Fast lossless compression of cv::Mat for in-memory caches
+
+#include "mat_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace {
+
+// Unsigned LEB128
+void putVarint(std::vector<uchar>& out, size_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(static_cast<uchar>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uchar>(v));
+}
+
+// False when the data ends inside the number
+bool getVarint(const uchar*& p, const uchar* end, size_t& v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uchar b = *p++;
+        v |= size_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool isBinaryMap(const cv::Mat& m)
+{
+    if (m.type() != CV_8UC1)
+        return false;
+    for (int r = 0; r < m.rows; ++r) {
+        const uchar* row = m.ptr<uchar>(r);
+        for (int c = 0; c < m.cols; ++c)
+            if (row[c] != 0 && row[c] != 255)
+                return false;
+    }
+    return true;
+}
+
+// Lengths of alternating runs, starting with a (possibly empty) run of 0;
+// the pixel count is implied by the Mat size
+std::vector<uchar> encodeBinaryRle(const cv::Mat& m)
+{
+    std::vector<uchar> out;
+    uchar value = 0;
+    size_t run = 0;
+    for (int r = 0; r < m.rows; ++r) {
+        const uchar* row = m.ptr<uchar>(r);
+        for (int c = 0; c < m.cols; ++c) {
+            if (row[c] == value) {
+                ++run;
+            } else {
+                putVarint(out, run);
+                value = row[c];
+                run = 1;
+            }
+        }
+    }
+    putVarint(out, run);
+    return out;
+}
+
+// False when the runs do not cover every pixel
+bool decodeBinaryRle(const std::vector<uchar>& in, cv::Mat& m)
+{
+    uchar* dst = m.ptr<uchar>();
+    uchar* const end = dst + m.total();
+    const uchar* p = in.data();
+    const uchar* const inEnd = p + in.size();
+    uchar value = 0;
+    while (dst < end) {
+        size_t run = 0;
+        if (!getVarint(p, inEnd, run))
+            return false;
+        run = std::min(run, size_t(end - dst));
+        std::memset(dst, value, run);
+        dst += run;
+        value = static_cast<uchar>(255 - value);
+    }
+    return true;
+}
+
+} // namespace
+
+size_t PackedMat::size() const
+{
+    return codec == Codec::Raw ? raw.total() * raw.elemSize() : bytes.size();
+}
+
+PackedMat packMat(const cv::Mat& m)
+{
+    PackedMat p;
+    p.rows = m.rows;
+    p.cols = m.cols;
+    p.type = m.type();
+    p.raw = m;
+    if (m.empty() || m.dims > 2)
+        return p;
+
+    const size_t rawBytes = m.total() * m.elemSize();
+    const size_t worthIt = rawBytes * 3 / 4;
+
+    if (isBinaryMap(m)) {
+        std::vector<uchar> rle = encodeBinaryRle(m);
+        if (rle.size() <= worthIt) {
+            p.codec = PackedMat::Codec::BinaryRle;
+            p.bytes = std::move(rle);
+            p.raw.release();
+            return p;
+        }
+    }
+
+#ifdef HAVE_LZ4
+    if (rawBytes > LZ4_MAX_INPUT_SIZE)
+        return p;
+    const cv::Mat src = m.isContinuous() ? m : m.clone();
+    std::vector<uchar> lz(LZ4_compressBound(static_cast<int>(rawBytes)));
+    const int n = LZ4_compress_default(reinterpret_cast<const char*>(src.data),
+                                       reinterpret_cast<char*>(lz.data()),
+                                       static_cast<int>(rawBytes), static_cast<int>(lz.size()));
+    if (n > 0 && size_t(n) <= worthIt) {
+        lz.resize(n);
+        lz.shrink_to_fit();
+        p.codec = PackedMat::Codec::Lz4;
+        p.bytes = std::move(lz);
+        p.raw.release();
+    }
+#endif
+    return p;
+}
+
+cv::Mat unpackMat(const PackedMat& p)
+{
+    if (p.codec == PackedMat::Codec::Raw)
+        return p.raw;
+
+    cv::Mat m(p.rows, p.cols, p.type);
+    bool complete = false;
+    if (p.codec == PackedMat::Codec::BinaryRle) {
+        complete = decodeBinaryRle(p.bytes, m);
+    }
+#ifdef HAVE_LZ4
+    else if (p.codec == PackedMat::Codec::Lz4) {
+        const int rawBytes = static_cast<int>(m.total() * m.elemSize());
+        complete = LZ4_decompress_safe(reinterpret_cast<const char*>(p.bytes.data()),
+                                       reinterpret_cast<char*>(m.data),
+                                       static_cast<int>(p.bytes.size()), rawBytes) == rawBytes;
+    }
+#endif
+    // A short or failed decode must never pass for the cached image
+    return complete ? m : cv::Mat();
+}
@@ -0,0 +1,28 @@
+// Fast lossless compression of cv::Mat for in-memory caches
+// Binary maps (edges, masks: only 0 and 255) are run-length coded; other data
+// uses LZ4 when the build found it (HAVE_LZ4). Data that does not shrink by
+// at least a quarter stays raw and shares the original buffer, so incompressible
+// entries cost neither a copy nor decode time.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+struct PackedMat {
+    enum class Codec { Raw, BinaryRle, Lz4 };
+
+    Codec codec = Codec::Raw;
+    int rows = 0, cols = 0, type = 0;
+    cv::Mat raw;               // Raw: the original data
+    std::vector<uchar> bytes;  // BinaryRle / Lz4: the compressed data
+
+    // Bytes held by this entry
+    size_t size() const;
+};
+
+PackedMat packMat(const cv::Mat& m);
+
+// Always a new buffer for compressed entries; the shared original for raw ones
+// Empty when compressed data does not decode to the full image
+cv::Mat unpackMat(const PackedMat& p);
@@ -0,0 +1,36 @@
+// Program-wide memoization of image operations
+
+#include "memo.hpp"
+#include "cache_manager.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+MemoImage memoSource(const cv::Mat& m)
+{
+    static std::atomic<uint64_t> next(0);
+    return MemoImage{ m, "#" + std::to_string(++next) };
+}
+
+std::string memoId(const std::string& op, const std::string& params, const MemoImage& input)
+{
+    return op + "(" + params + "):" + input.id;
+}
+
+bool memoCached(const std::string& op, const std::string& params, const MemoImage& input)
+{
+    return !input.id.empty() && CacheManager::shared().contains(op, params + ":" + input.id);
+}
+
+MemoImage memoize(const std::string& op, const std::string& params, const MemoImage& input,
+                  const std::function<cv::Mat(const cv::Mat&)>& compute)
+{
+    if (input.id.empty())
+        return memoUnregistered(compute(input.mat));
+
+    MemoImage out;
+    out.mat = CacheManager::shared().getOrCompute(op, params + ":" + input.id,
+                                                  [&] { return compute(input.mat); });
+    out.id = memoId(op, params, input);
+    return out;
+}
@@ -0,0 +1,40 @@
+// Program-wide memoization of image operations
+// A result is keyed by (operation, parameters, input identity). Source images
+// get a process-unique identity when registered; a memoized result's identity
+// is derived from its own key, so chained stages (a blur, then Canny of that
+// blur) are found again whichever pipeline, session or callback asked first.
+// Results live in the shared CacheManager, one cache per operation, under its
+// budget and eviction.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <functional>
+#include <string>
+
+struct MemoImage {
+    cv::Mat mat;     // shared with the cache, must not be written to
+    std::string id;  // empty: unregistered, operations on it always compute
+};
+
+// Register a source image; every call yields a new identity (version), so
+// results of an earlier image never stand in for a changed one
+MemoImage memoSource(const cv::Mat& m);
+
+// Wrap an image without registering it, for inputs seen only once or runs
+// that must compute every time
+inline MemoImage memoUnregistered(const cv::Mat& m)
+{
+    return MemoImage{ m, std::string() };
+}
+
+// Identity of op(params) applied to input, without computing it
+std::string memoId(const std::string& op, const std::string& params, const MemoImage& input);
+
+// Whether op(params) of input is cached, without counting a hit or miss
+bool memoCached(const std::string& op, const std::string& params, const MemoImage& input);
+
+// op(params) of input, computed at most once while it stays cached
+// (two threads missing the same key at once may both compute it)
+MemoImage memoize(const std::string& op, const std::string& params, const MemoImage& input,
+                  const std::function<cv::Mat(const cv::Mat&)>& compute);
@@ -0,0 +1,36 @@
+// Destinations for encoded results
+
+#include "output_sink.hpp"
+#include "pack_archive.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+
+FileSink::FileSink(const std::string& dir)
+    : dir_(dir)
+{
+}
+
+bool FileSink::write(const std::string& name, const cv::Mat& image)
+{
+    return cv::imwrite(dir_.empty() ? name : dir_ + "/" + name, image);
+}
+
+std::unique_ptr<OutputSink> makeOutputSink(const std::string& dir, const std::string& packDir,
+                                           std::string& err)
+{
+    if (packDir.empty())
+        return std::make_unique<FileSink>(dir);
+    auto pack = std::make_unique<PackSink>(packDir);
+    if (!pack->isOpen()) {
+        err = "Could not open pack archive '" + packDir + "'";
+        return nullptr;
+    }
+    return pack;
+}
+
+std::string outputName(const std::string& inputPath, const std::string& suffix)
+{
+    const size_t slash = inputPath.find_last_of("/\\");
+    const std::string name = (slash == std::string::npos) ? inputPath : inputPath.substr(slash + 1);
+    return name.substr(0, name.find_last_of('.')) + suffix;
+}
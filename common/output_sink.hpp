@@ -0,0 +1,47 @@
+// Destinations for encoded results
+// Batch runs write every output through a sink, so outputs can go either to
+// one file per image or to a packed archive (see pack_archive.hpp)
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    // Encode image (format from the extension of name) and store it under name
+    // Safe to call from several threads
+    virtual bool write(const std::string& name, const cv::Mat& image) = 0;
+
+    // Make everything written so far visible to readers (long-lived runs
+    // call this when they go idle); sinks that write through do nothing
+    virtual bool flush() { return true; }
+
+    // Directory the outputs land in
+    virtual std::string dir() const = 0;
+};
+
+// One file per output, placed in a directory ("" writes name as given)
+class FileSink : public OutputSink
+{
+public:
+    explicit FileSink(const std::string& dir = "");
+    bool write(const std::string& name, const cv::Mat& image) override;
+    std::string dir() const override { return dir_.empty() ? "." : dir_; }
+
+private:
+    std::string dir_;
+};
+
+// Sink of a batch run: a pack archive in packDir when given, else one file
+// per output in dir. Returns null with a message in err when it cannot open.
+std::unique_ptr<OutputSink> makeOutputSink(const std::string& dir, const std::string& packDir,
+                                           std::string& err);
+
+// Output name for an input: its file name without directory or extension,
+// followed by suffix ("plates/a.jpg", "_overlay.jpg" -> "a_overlay.jpg")
+std::string outputName(const std::string& inputPath, const std::string& suffix);
@@ -0,0 +1,232 @@
+// Packed output archive
+
+#include "pack_archive.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PACK_HAVE_MMAP 1
+#endif
+
+std::string packFileName(const std::string& dir, int n)
+{
+    return cv::format("%s/pack-%05d.bin", dir.c_str(), n);
+}
+
+PackWriter::PackWriter(const std::string& dir, size_t maxPackBytes, size_t bufferBytes)
+    : dir_(dir), maxPackBytes_(maxPackBytes)
+{
+    buffer_.reserve(bufferBytes);
+    cv::utils::fs::createDirectories(dir_);
+    index_ = std::fopen((dir_ + "/index.txt").c_str(), "ab");
+}
+
+PackWriter::~PackWriter()
+{
+    flush();
+    if (pack_) std::fclose(pack_);
+    if (index_) std::fclose(index_);
+}
+
+bool PackWriter::openPack()
+{
+    if (pack_) std::fclose(pack_);
+
+    // Continue numbering after packs left by earlier runs (index is appended to)
+    do {
+        ++packNo_;
+        std::FILE* existing = std::fopen(packFileName(dir_, packNo_).c_str(), "rb");
+        if (!existing) break;
+        std::fclose(existing);
+    } while (true);
+
+    pack_ = std::fopen(packFileName(dir_, packNo_).c_str(), "wb");
+    packBytes_ = 0;
+    return pack_ != nullptr;
+}
+
+bool PackWriter::flushLocked()
+{
+    if (!buffer_.empty()) {
+        ok_ = ok_ && std::fwrite(buffer_.data(), 1, buffer_.size(), pack_) == buffer_.size();
+        ok_ = ok_ && std::fflush(pack_) == 0;
+        buffer_.clear();
+    }
+    // Index lines only after their payloads are on disk
+    if (!pendingIndex_.empty()) {
+        ok_ = ok_ && std::fwrite(pendingIndex_.data(), 1, pendingIndex_.size(), index_) == pendingIndex_.size();
+        ok_ = ok_ && std::fflush(index_) == 0;
+        pendingIndex_.clear();
+    }
+    return ok_;
+}
+
+bool PackWriter::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!index_) return false;
+    return flushLocked();
+}
+
+bool PackWriter::append(const std::string& key, const uchar* data, size_t len)
+{
+    if (key.find_first_of("\t\n") != std::string::npos)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!index_ || !ok_)
+        return false;
+
+    // Start a new pack when this entry would overflow the current one
+    if (!pack_ || (packBytes_ > 0 && packBytes_ + len > maxPackBytes_)) {
+        if (!flushLocked() || !openPack())
+            return ok_ = false;
+    }
+
+    const size_t offset = packBytes_;
+    if (buffer_.size() + len > buffer_.capacity())
+        flushLocked();
+    if (len >= buffer_.capacity()) {
+        // Larger than the buffer: write through
+        ok_ = ok_ && std::fwrite(data, 1, len, pack_) == len;
+    } else {
+        buffer_.insert(buffer_.end(), data, data + len);
+    }
+    packBytes_ += len;
+
+    pendingIndex_ += key + "\t" + std::to_string(packNo_) + "\t" + std::to_string(offset) +
+                     "\t" + std::to_string(len) + "\n";
+    if (buffer_.empty())
+        flushLocked();
+    return ok_;
+}
+
+PackSink::PackSink(const std::string& dir)
+    : writer_(dir)
+{
+}
+
+bool PackSink::write(const std::string& name, const cv::Mat& image)
+{
+    const size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+
+    std::vector<uchar> encoded;
+    if (!cv::imencode(name.substr(dot), image, encoded))
+        return false;
+    return writer_.append(name, encoded.data(), encoded.size());
+}
+
+PackReader::PackReader(const std::string& dir)
+    : dir_(dir)
+{
+    std::ifstream index(dir_ + "/index.txt");
+    if (!index)
+        return;
+
+    std::string line;
+    while (std::getline(index, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        Entry e;
+        if (!std::getline(fields, key, '\t') || !(fields >> e.pack >> e.offset >> e.length))
+            continue;
+        // Later entries with the same key replace earlier ones
+        if (!entries_.count(key))
+            keys_.push_back(key);
+        entries_[key] = e;
+    }
+    open_ = true;
+}
+
+PackReader::~PackReader()
+{
+#ifdef PACK_HAVE_MMAP
+    for (auto& m : mappings_)
+        if (m.second.data)
+            munmap(const_cast<uchar*>(m.second.data), m.second.size);
+#else
+    for (auto& m : mappings_)
+        delete[] m.second.data;
+#endif
+}
+
+const PackReader::Mapping* PackReader::mapPack(int pack)
+{
+    auto it = mappings_.find(pack);
+    if (it != mappings_.end())
+        return it->second.data ? &it->second : nullptr;
+
+    Mapping m;
+    const std::string path = packFileName(dir_, pack);
+#ifdef PACK_HAVE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            m.data = static_cast<const uchar*>(p);
+            m.size = static_cast<size_t>(st.st_size);
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (in) {
+        m.size = static_cast<size_t>(in.tellg());
+        uchar* data = new uchar[m.size];
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(m.size));
+        m.data = data;
+    }
+#endif
+    auto inserted = mappings_.emplace(pack, m).first;
+    return m.data ? &inserted->second : nullptr;
+}
+
+const uchar* PackReader::map(const std::string& key, size_t& length)
+{
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+        return nullptr;
+
+    const Entry& e = it->second;
+    const Mapping* m = mapPack(e.pack);
+    if (!m || e.offset + e.length > m->size)
+        return nullptr;
+
+    length = e.length;
+    return m->data + e.offset;
+}
+
+cv::Mat PackReader::decode(const std::string& key, int flags)
+{
+    size_t length = 0;
+    const uchar* data = map(key, length);
+    if (!data)
+        return cv::Mat();
+
+    const cv::Mat bytes(1, static_cast<int>(length), CV_8UC1, const_cast<uchar*>(data));
+    return cv::imdecode(bytes, flags);
+}
+
+bool PackReader::extract(const std::string& key, const std::string& outPath)
+{
+    size_t length = 0;
+    const uchar* data = map(key, length);
+    if (!data)
+        return false;
+
+    std::ofstream out(outPath, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    return static_cast<bool>(out);
+}
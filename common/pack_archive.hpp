@@ -0,0 +1,116 @@
+// Packed output archive
+// Encoded results are appended to a few large pack files instead of one file
+// per output, with a text index of (key, pack, offset, length). Writes go
+// through a large in-memory buffer, so the filesystem sees few big sequential
+// writes and few inodes.
+//
+// Layout of an archive directory:
+//   pack-00000.bin, pack-00001.bin, ...   concatenated payloads
+//   index.txt                             one "key<TAB>pack<TAB>offset<TAB>length" line per entry
+
+#pragma once
+
+#include "output_sink.hpp"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PackWriter
+{
+public:
+    explicit PackWriter(const std::string& dir, size_t maxPackBytes = size_t(1) << 30,
+                        size_t bufferBytes = size_t(8) << 20);
+    ~PackWriter();
+
+    PackWriter(const PackWriter&) = delete;
+    PackWriter& operator=(const PackWriter&) = delete;
+
+    bool isOpen() const { return index_ != nullptr; }
+    const std::string& dir() const { return dir_; }
+
+    // Append one entry; keys must not contain tabs or newlines. Thread-safe.
+    bool append(const std::string& key, const uchar* data, size_t len);
+
+    // Flush buffered payloads and their index lines to disk
+    bool flush();
+
+private:
+    bool openPack();
+    bool flushLocked();
+
+    std::string dir_;
+    size_t maxPackBytes_;
+    std::vector<uchar> buffer_;
+    std::string pendingIndex_;  // index lines for payloads still in buffer_
+
+    std::mutex mutex_;
+    std::FILE* pack_ = nullptr;
+    std::FILE* index_ = nullptr;
+    int packNo_ = -1;
+    size_t packBytes_ = 0;  // bytes of the current pack, including buffered ones
+    bool ok_ = true;
+};
+
+// OutputSink storing encoded images in a pack archive
+class PackSink : public OutputSink
+{
+public:
+    explicit PackSink(const std::string& dir);
+    bool isOpen() const { return writer_.isOpen(); }
+    bool write(const std::string& name, const cv::Mat& image) override;
+    bool flush() override { return writer_.flush(); }
+    std::string dir() const override { return writer_.dir(); }
+
+private:
+    PackWriter writer_;
+};
+
+// Read access to a pack archive; entries are served from memory-mapped packs
+class PackReader
+{
+public:
+    struct Entry {
+        int pack;
+        size_t offset;
+        size_t length;
+    };
+
+    explicit PackReader(const std::string& dir);
+    ~PackReader();
+
+    PackReader(const PackReader&) = delete;
+    PackReader& operator=(const PackReader&) = delete;
+
+    bool isOpen() const { return open_; }
+    const std::vector<std::string>& keys() const { return keys_; }
+    bool contains(const std::string& key) const { return entries_.count(key) != 0; }
+
+    // Pointer to the entry bytes inside the mapped pack (valid while the reader lives)
+    const uchar* map(const std::string& key, size_t& length);
+
+    // Decode an entry directly from the mapping
+    cv::Mat decode(const std::string& key, int flags = -1);
+
+    // Write an entry to a file unchanged
+    bool extract(const std::string& key, const std::string& outPath);
+
+private:
+    struct Mapping {
+        const uchar* data = nullptr;
+        size_t size = 0;
+    };
+
+    const Mapping* mapPack(int pack);
+
+    std::string dir_;
+    bool open_ = false;
+    std::vector<std::string> keys_;  // in archive order
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<int, Mapping> mappings_;
+};
+
+// File name of pack number n inside an archive directory
+std::string packFileName(const std::string& dir, int n);
@@ -0,0 +1,101 @@
+// Coarse-then-fine rendering for interactive controls
+
+#include "progressive_render.hpp"
+
+#include <algorithm>
+
+ProgressiveRenderer::ProgressiveRenderer()
+    : worker_([this] { workerLoop(); })
+{
+}
+
+ProgressiveRenderer::~ProgressiveRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    done_.notify_all();
+    worker_.join();
+}
+
+void ProgressiveRenderer::request(Render fine)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        next_ = std::move(fine);
+        ++requested_;
+    }
+    wake_.notify_one();
+}
+
+void ProgressiveRenderer::cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_ = nullptr;
+    finished_ = delivered_ = ++requested_;
+    result_.release();
+}
+
+bool ProgressiveRenderer::poll(cv::Mat& result)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_ != requested_ || delivered_ == finished_)
+        return false;
+    delivered_ = finished_;
+    result = result_;
+    return true;
+}
+
+bool ProgressiveRenderer::wait(cv::Mat& result)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (delivered_ == requested_)
+        return false;
+    done_.wait(lock, [this] { return stopping_ || finished_ == requested_; });
+    if (finished_ != requested_)
+        return false;
+    delivered_ = finished_;
+    result = result_;
+    return true;
+}
+
+void ProgressiveRenderer::workerLoop()
+{
+    for (;;) {
+        Render job;
+        uint64_t seq = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || next_; });
+            if (stopping_)
+                return;
+            job = std::move(next_);
+            next_ = nullptr;
+            seq = requested_;
+        }
+
+        cv::Mat out = job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (seq != requested_)
+                continue;  // superseded while rendering
+            result_ = out;
+            finished_ = seq;
+        }
+        done_.notify_all();
+    }
+}
+
+double proxyScale(cv::Size size, int maxSide)
+{
+    double scale = 1.0;
+    int longest = std::max(size.width, size.height);
+    while (longest > maxSide) {
+        longest = (longest + 1) / 2;
+        scale /= 2.0;
+    }
+    return scale;
+}
@@ -0,0 +1,60 @@
+// Coarse-then-fine rendering for interactive controls
+// A control callback shows a result computed on a small proxy right away and
+// hands the full-resolution render to a background worker; the event loop
+// polls for it and replaces the preview once it is ready. Only the newest
+// request is ever delivered: results of renders superseded by a later change
+// are dropped, and requests queued behind a running render collapse to the
+// latest one.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class ProgressiveRenderer
+{
+public:
+    using Render = std::function<cv::Mat()>;
+
+    ProgressiveRenderer();
+    ~ProgressiveRenderer();
+
+    ProgressiveRenderer(const ProgressiveRenderer&) = delete;
+    ProgressiveRenderer& operator=(const ProgressiveRenderer&) = delete;
+
+    // Render fine in the background, superseding any earlier request
+    void request(Render fine);
+
+    // Supersede earlier requests without starting a new render (the caller
+    // already has the final result, e.g. from a cache)
+    void cancel();
+
+    // Result of the latest request, returned once when it is done
+    bool poll(cv::Mat& result);
+
+    // Block until the latest request is done; false if there is nothing
+    // left to deliver
+    bool wait(cv::Mat& result);
+
+private:
+    void workerLoop();
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Render next_;
+    uint64_t requested_ = 0;  // sequence number of the latest request
+    uint64_t finished_ = 0;   // latest request whose result is in result_
+    uint64_t delivered_ = 0;  // latest request handed out by poll/wait
+    cv::Mat result_;
+    bool stopping_ = false;
+};
+
+// Proxy scale for coarse previews: 1 / 2^k so that the long side of size fits
+// in maxSide; 1.0 when the image is small enough to render directly
+double proxyScale(cv::Size size, int maxSide = 512);
@@ -0,0 +1,78 @@
+// Fixed-size worker pool for independent sessions
+// Used by batch runs to process several images at once; every task owns its
+// own session state, so tasks share nothing but what they capture explicitly
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads)
+    {
+        for (int i = 0; i < std::max(threads, 1); ++i)
+            workers_.emplace_back([this] { workerLoop(); });
+    }
+
+    // Queued tasks still run before the workers exit
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : workers_)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Run task on a worker; the future carries its result or exception
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())>
+    {
+        using R = decltype(task());
+        auto job = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+        std::future<R> result = job->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.emplace([job] { (*job)(); });
+        }
+        wake_.notify_one();
+        return result;
+    }
+
+private:
+    void workerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                job = std::move(queue_.front());
+                queue_.pop();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> queue_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
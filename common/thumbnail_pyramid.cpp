@@ -0,0 +1,75 @@
+// Multi-resolution thumbnail output
+
+#include "thumbnail_pyramid.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+struct Thumbnail {
+    cv::Mat image;
+    std::string path;  // name within the sink
+};
+
+// Insert a suffix before the extension of path
+std::string withSuffix(const std::string& path, const std::string& suffix)
+{
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + suffix;
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+} // namespace
+
+int writeThumbnailPyramid(const cv::Mat& image, const std::string& name, OutputSink& sink,
+                          const ThumbnailSpec& spec)
+{
+    if (image.empty())
+        return 0;
+
+    // Cascade: level k is the previous level halved, down to the largest divisor
+    const int maxDivisor = spec.divisors.empty() ? 1
+        : *std::max_element(spec.divisors.begin(), spec.divisors.end());
+    std::vector<cv::Mat> cascade{ image };
+    std::vector<int> cascadeDivisor{ 1 };
+    while (cascadeDivisor.back() < maxDivisor && cascade.back().cols > 1 && cascade.back().rows > 1) {
+        cv::Mat half;
+        cv::resize(cascade.back(), half, cv::Size((cascade.back().cols + 1) / 2, (cascade.back().rows + 1) / 2),
+                   0, 0, cv::INTER_AREA);
+        cascade.push_back(half);
+        cascadeDivisor.push_back(cascadeDivisor.back() * 2);
+    }
+
+    std::vector<Thumbnail> thumbs;
+    for (int d : spec.divisors) {
+        const auto it = std::find(cascadeDivisor.begin(), cascadeDivisor.end(), d);
+        if (it != cascadeDivisor.end())
+            thumbs.push_back({ cascade[it - cascadeDivisor.begin()],
+                               withSuffix(name, "_1of" + std::to_string(d)) });
+    }
+
+    // Fixed widths are resized from the smallest cascade level still wider
+    // than the target, so they never read the full-resolution image twice
+    for (int w : spec.widths) {
+        if (w <= 0 || w >= image.cols) continue;
+        size_t src = 0;
+        while (src + 1 < cascade.size() && cascade[src + 1].cols >= w)
+            ++src;
+        const int h = std::max(1, cvRound(static_cast<double>(image.rows) * w / image.cols));
+        cv::Mat resized;
+        cv::resize(cascade[src], resized, cv::Size(w, h), 0, 0, cv::INTER_AREA);
+        thumbs.push_back({ resized, withSuffix(name, "_w" + std::to_string(w)) });
+    }
+
+    std::atomic<int> failures{ 0 };
+    cv::parallel_for_(cv::Range(0, static_cast<int>(thumbs.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i)
+            if (!sink.write(thumbs[i].path, thumbs[i].image))
+                ++failures;
+    }, static_cast<double>(thumbs.size()));
+    return failures.load();
+}
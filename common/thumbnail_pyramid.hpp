@@ -0,0 +1,22 @@
+// Multi-resolution thumbnail output
+// All sizes come from one cascaded downsampling pass over the in-memory
+// result (each level is halved from the previous one), and the levels are
+// encoded in parallel
+
+#pragma once
+
+#include "output_sink.hpp"
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+struct ThumbnailSpec {
+    std::vector<int> divisors = { 2, 4, 8 };  // power-of-two fractions of the full size
+    std::vector<int> widths   = { 256 };      // fixed-width thumbnails (aspect preserved)
+};
+
+// Write thumbnails of an output named <stem>.<ext> to sink as <stem>_1of<d>.<ext>
+// and <stem>_w<width>.<ext>; returns the number of thumbnails that failed to write
+int writeThumbnailPyramid(const cv::Mat& image, const std::string& name, OutputSink& sink,
+                          const ThumbnailSpec& spec = ThumbnailSpec());
@@ -4,10 +4,31 @@
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#ifndef TOOLKIT_HEADLESS
 #include <opencv2/highgui.hpp>
+#endif
+#include "tile_viewer.hpp"
+#include "thumbnail_pyramid.hpp"
+#include "output_sink.hpp"
+#include "async_decode.hpp"
+#include "thread_pool.hpp"
+#include "cache_manager.hpp"
+#include "idle_prefetcher.hpp"
+#include "progressive_render.hpp"
+#include "image_metrics.hpp"
+#include "memo.hpp"
+#include "folder_watcher.hpp"
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
+#ifndef TOOLKIT_HEADLESS
 // Utility: Display image with optional scaling for large images
 static void safeImShow(const std::string& winName, const cv::Mat& img, int maxSide = 1000)
 {
@@ -29,85 +50,860 @@ static void safeImShow(const std::string& winName, const cv::Mat& img, int maxSi
     }
 }
 
+// Utility: Show a proxy-resolution preview at the size the full-resolution
+// result will be shown with
+static void showPreview(const std::string& winName, const cv::Mat& preview, cv::Size fullSize, int maxSide = 1000)
+{
+    const double s = std::min(1.0, static_cast<double>(maxSide) / std::max(fullSize.width, fullSize.height));
+    cv::Mat shown;
+    cv::resize(preview, shown, cv::Size(cvRound(fullSize.width * s), cvRound(fullSize.height * s)),
+               0, 0, cv::INTER_NEAREST);
+    safeImShow(winName, shown, maxSide);
+}
+
 // Utility: Show and position window on screen
 static void showAndPlace(const std::string& winName, const cv::Mat& img, int x, int y, int maxSide = 1000)
 {
     safeImShow(winName, img, maxSide);
     cv::moveWindow(winName, x, y);
 }
+#endif
+
+// Flipped view of an image without copying pixels
+// Rows and columns are index-mapped onto the source; kernels read the source
+// directly and only materialize() produces a contiguous flipped copy
+struct FlipView {
+    cv::Mat src;
+    bool vert  = false;  // rows reversed
+    bool horiz = false;  // columns reversed
+
+    FlipView() = default;
+
+    // flipCode follows cv::flip: 0 vertical, >0 horizontal, <0 both
+    FlipView(const cv::Mat& img, int flipCode)
+        : src(img), vert(flipCode <= 0), horiz(flipCode != 0) {}
+
+    // View of this view flipped again (flips compose by toggling axes)
+    FlipView flipped(int flipCode) const
+    {
+        FlipView v = *this;
+        v.vert  = vert  != (flipCode <= 0);
+        v.horiz = horiz != (flipCode != 0);
+        return v;
+    }
+
+    bool isFlipped() const { return vert || horiz; }
+
+    // cv::flip code of a flipped view; cv::flip has no code for identity,
+    // so callers check isFlipped() first
+    int flipCode() const { return vert ? (horiz ? -1 : 0) : 1; }
+
+    // Same flips applied to another image (e.g. a downscaled source)
+    FlipView over(const cv::Mat& img) const
+    {
+        FlipView v = *this;
+        v.src = img;
+        return v;
+    }
+
+    // Contiguous copy, for consumers that need a real buffer
+    cv::Mat materialize() const
+    {
+        if (!isFlipped()) return src;
+        cv::Mat out;
+        cv::flip(src, out, flipCode());
+        return out;
+    }
+};
+
+// Copy source rows [s0, s1) of a strip into view order
+// Rows are reversed for vertical flips and mirrored for horizontal flips
+static void placeStripRows(const cv::Mat& strip, const FlipView& v, int s0, cv::Mat& dst)
+{
+    for (int i = 0; i < strip.rows; ++i) {
+        const int srcRow = s0 + i;
+        const int y = v.vert ? v.src.rows - 1 - srcRow : srcRow;
+        const uchar* in = strip.ptr<uchar>(i);
+        uchar* out = dst.ptr<uchar>(y);
+        if (v.horiz)
+            std::reverse_copy(in, in + strip.cols, out);
+        else
+            std::copy(in, in + strip.cols, out);
+    }
+}
+
+// Grayscale of a flipped view, read straight from the unflipped source
+// Conversion runs on source row strips; only the single-channel result is
+// reordered, so the full color copy made by cv::flip is never created
+// A single-channel source (luma decode) is only reordered, never converted
+static void flipViewToGray(const FlipView& v, cv::Mat& gray)
+{
+    const bool luma = v.src.channels() == 1;
+    if (!v.isFlipped()) {
+        if (luma)
+            gray = v.src;
+        else
+            cv::cvtColor(v.src, gray, cv::COLOR_BGR2GRAY);
+        return;
+    }
+
+    gray.create(v.src.size(), CV_8UC1);
+
+    const int STRIP_ROWS = 32;
+    const int nStrips = (v.src.rows + STRIP_ROWS - 1) / STRIP_ROWS;
+    cv::parallel_for_(cv::Range(0, nStrips), [&](const cv::Range& range) {
+        cv::Mat strip;
+        for (int s = range.start; s < range.end; ++s) {
+            const int s0 = s * STRIP_ROWS;
+            const int s1 = std::min(v.src.rows, s0 + STRIP_ROWS);
+            if (luma) {
+                placeStripRows(v.src.rowRange(s0, s1), v, s0, gray);
+            } else {
+                cv::cvtColor(v.src.rowRange(s0, s1), strip, cv::COLOR_BGR2GRAY);
+                placeStripRows(strip, v, s0, gray);
+            }
+        }
+    });
+}
+
+#ifndef TOOLKIT_HEADLESS
+// Display a flipped view: large images are downscaled from the source first
+// and only the small display image is flipped (area resampling is symmetric,
+// so this matches flipping first for display purposes)
+static void showViewAndPlace(const std::string& winName, const FlipView& v, int x, int y, int maxSide)
+{
+    const int longest = std::max(v.src.rows, v.src.cols);
+    if (v.src.empty() || maxSide <= 0 || longest <= maxSide) {
+        showAndPlace(winName, v.materialize(), x, y, maxSide);
+        return;
+    }
+
+    const double scale = static_cast<double>(maxSide) / static_cast<double>(longest);
+    cv::Mat scaled;
+    cv::resize(v.src, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+    showAndPlace(winName, v.over(scaled).materialize(), x, y, maxSide);
+}
+#endif
 
 // Convert slider values to usable parameters
 static inline double sliderToSigma(int v) { return static_cast<double>(v) / 10.0; }
 static inline int sliderToOddKernel(int v) { return 2 * v + 1; }
 
+// Gaussian blur computed in row strips, collecting a 256-bin histogram of
+// each blurred strip while it is still in cache (no extra pass over the image)
+// Strips are ROIs of the full image, so the blur reads real neighbor rows
+// across strip borders and the result matches a whole-image GaussianBlur
+static void blurWithHistogram(const cv::Mat& gray, cv::Mat& blurred, cv::Size ksize,
+                              double sigma, int hist[256])
+{
+    const int STRIP_ROWS = 64;
+    const int nStrips = (gray.rows + STRIP_ROWS - 1) / STRIP_ROWS;
+
+    blurred.create(gray.size(), gray.type());
+    std::vector<int> stripHist(static_cast<size_t>(nStrips) * 256, 0);
+
+    cv::parallel_for_(cv::Range(0, nStrips), [&](const cv::Range& range) {
+        for (int s = range.start; s < range.end; ++s) {
+            const int r0 = s * STRIP_ROWS;
+            const int r1 = std::min(gray.rows, r0 + STRIP_ROWS);
+            cv::Mat dst = blurred.rowRange(r0, r1);
+            cv::GaussianBlur(gray.rowRange(r0, r1), dst, ksize, sigma, sigma);
+
+            int* h = &stripHist[static_cast<size_t>(s) * 256];
+            for (int r = 0; r < dst.rows; ++r) {
+                const uchar* row = dst.ptr<uchar>(r);
+                for (int c = 0; c < dst.cols; ++c)
+                    h[row[c]] += 1;
+            }
+        }
+    });
+
+    std::fill(hist, hist + 256, 0);
+    for (int s = 0; s < nStrips; ++s)
+        for (int i = 0; i < 256; ++i)
+            hist[i] += stripHist[static_cast<size_t>(s) * 256 + i];
+}
+
+// 256-bin histogram of a grayscale image
+static void grayHistogram(const cv::Mat& gray, int hist[256])
+{
+    std::fill(hist, hist + 256, 0);
+    for (int r = 0; r < gray.rows; ++r) {
+        const uchar* row = gray.ptr<uchar>(r);
+        for (int c = 0; c < gray.cols; ++c)
+            hist[row[c]] += 1;
+    }
+}
+
+// Median intensity from a 256-bin histogram
+static int histogramMedian(const int hist[256])
+{
+    long long total = 0;
+    for (int i = 0; i < 256; ++i) total += hist[i];
+
+    long long acc = 0;
+    for (int i = 0; i < 256; ++i) {
+        acc += hist[i];
+        if (2 * acc >= total) return i;
+    }
+    return 255;
+}
+
+// Canny thresholds around the median of the blurred image (+-33%)
+static void autoCannyThresholds(const int hist[256], double& th1, double& th2)
+{
+    const double sigma = 0.33;
+    const double median = static_cast<double>(histogramMedian(hist));
+    th1 = std::max(0.0,   (1.0 - sigma) * median);
+    th2 = std::min(255.0, (1.0 + sigma) * median);
+}
+
+// Kernel size GaussianBlur derives from sigma for 8-bit images when given
+// Size(0, 0); resolved up front so both spellings of one blur share a memo entry
+static int gaussianKernelSize(int ksize, double sigma)
+{
+    return ksize > 0 ? ksize : (cvRound(sigma * 3 * 2 + 1) | 1);
+}
+
+// Memo parameters of the blur and Canny stages
+static std::string blurParams(int ksize, double sigma) { return cv::format("%d/%.2f", ksize, sigma); }
+static std::string cannyParams(double th1, double th2) { return cv::format("%.2f/%.2f", th1, th2); }
+
+// Memoized Gaussian blur (ksize 0: derived from sigma)
+static MemoImage memoGaussianBlur(const MemoImage& in, int ksize, double sigma)
+{
+    ksize = gaussianKernelSize(ksize, sigma);
+    return memoize("gaussian-blur", blurParams(ksize, sigma), in, [=](const cv::Mat& src) {
+        cv::Mat dst;
+        cv::GaussianBlur(src, dst, cv::Size(ksize, ksize), sigma, sigma);
+        return dst;
+    });
+}
+
+// Memoized Canny edge map
+static MemoImage memoCanny(const MemoImage& in, double th1, double th2)
+{
+    return memoize("canny", cannyParams(th1, th2), in, [=](const cv::Mat& src) {
+        cv::Mat edges;
+        cv::Canny(src, edges, th1, th2);
+        return edges;
+    });
+}
+
+// Blur + Canny with either fixed (20/60) or automatic thresholds
+// Both stages are memoized; the histogram for automatic thresholds comes
+// fused with the blur when it is computed, or from one pass over a cached blur
+static void detectEdges(const MemoImage& gray, bool autoCanny, MemoImage& blurred, MemoImage& edges,
+                        double& th1, double& th2)
+{
+    const double sigma = 2.0;
+    const int ksize = gaussianKernelSize(0, sigma);
+    int hist[256];
+    bool fused = false;
+    blurred = memoize("gaussian-blur", blurParams(ksize, sigma), gray, [&](const cv::Mat& src) {
+        cv::Mat dst;
+        blurWithHistogram(src, dst, cv::Size(ksize, ksize), sigma, hist);
+        fused = true;
+        return dst;
+    });
+
+    th1 = 20.0;
+    th2 = 60.0;
+    if (autoCanny) {
+        if (!fused)
+            grayHistogram(blurred.mat, hist);
+        autoCannyThresholds(hist, th1, th2);
+    }
+    edges = memoCanny(blurred, th1, th2);
+}
+
+// Settings shared by every image of a batch run
+struct BatchOptions {
+    bool autoCanny = false;
+    OutputSink* sink = nullptr;  // output files or pack archive
+    bool thumbnails = false;
+    ThumbnailSpec thumbSpec;
+    int jobs = 1;                // inputs processed concurrently
+    bool luma = false;           // decode straight to grayscale (edge maps need no color)
+};
+
+// Log and failure count shared by the inputs of a batch or watch run
+struct BatchLog {
+    std::mutex mutex;
+    std::atomic<int> failures{0};
+};
+
+// Edge map of one input as an independent session, written to the sink
+static void processInput(const BatchOptions& opt, BatchLog& log, const std::string& path)
+{
+    // Luma decode takes the JPEG Y channel as is: no color conversion, and
+    // a third of the decoded bytes to flip and filter
+    const cv::Mat input = cv::imread(path, opt.luma ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    if (input.empty()) {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        std::cerr << "Warning: Could not load '" << path << "'\n";
+        ++log.failures;
+        return;
+    }
+
+    // Same geometry as the fixed pipeline (vertical then horizontal flip)
+    cv::Mat gray;
+    flipViewToGray(FlipView(input, 0).flipped(1), gray);
+
+    // Batch inputs are seen once, so their stages are not memoized
+    MemoImage blurred, edgeMap;
+    double th1 = 0.0, th2 = 0.0;
+    detectEdges(memoUnregistered(gray), opt.autoCanny, blurred, edgeMap, th1, th2);
+    const cv::Mat& edges = edgeMap.mat;
+
+    const std::string outName = outputName(path, "_edges.png");
+
+    const bool written = opt.sink->write(outName, edges);
+    const bool thumbsFailed = opt.thumbnails &&
+        writeThumbnailPyramid(edges, outName, *opt.sink, opt.thumbSpec) > 0;
+
+    std::lock_guard<std::mutex> lock(log.mutex);
+    std::cout << path << ": Canny thresholds " << th1 << "/" << th2
+              << (opt.autoCanny ? " (auto)" : "") << "\n";
+    if (!written) {
+        std::cerr << "Warning: Failed to write " << outName << "\n";
+        ++log.failures;
+    }
+    if (thumbsFailed) {
+        std::cerr << "Warning: Failed to write thumbnails of " << outName << "\n";
+        ++log.failures;
+    }
+}
+
+// Headless edge detection of every input matching a glob pattern
+// Each input is an independent session on the worker pool
+static int runBatch(const std::string& pattern, const BatchOptions& opt)
+{
+    std::vector<cv::String> files;
+    cv::glob(pattern, files, false);
+    if (files.empty()) {
+        std::cerr << "Error: No input matches '" << pattern << "'\n";
+        return 1;
+    }
+
+    BatchLog log;
+    {
+        ThreadPool pool(std::min<int>(opt.jobs, int(files.size())));
+        std::vector<std::future<void>> done;
+        for (const cv::String& path : files)
+            done.push_back(pool.submit([&opt, &log, &path] { processInput(opt, log, path); }));
+        for (std::future<void>& f : done)
+            f.get();
+    }
+    return log.failures == 0 ? 0 : 1;
+}
+
+// Watch mode: edge maps of every input arriving in the directory of pattern
+// until interrupted, from one warm process instead of one process per file
+static int runWatch(const std::string& pattern, const BatchOptions& opt)
+{
+    if (!FolderWatcher::supported()) {
+        std::cerr << "Error: --watch is not supported on this platform (needs inotify)\n";
+        return 1;
+    }
+    FolderWatcher watcher(pattern);
+    if (!watcher.isOpen()) {
+        std::cerr << "Error: Could not watch '" << watcher.dir() << "'\n";
+        return 1;
+    }
+    if (watcher.watches(opt.sink->dir())) {
+        std::cerr << "Error: Outputs would land in the watched directory '" << watcher.dir()
+             << "' and be picked up again; choose another --out-dir or --pack\n";
+        return 1;
+    }
+
+    std::cout << "Watching " << watcher.dir() << " for images (Ctrl-C stops)" << std::endl;
+    BatchLog log;
+    std::atomic<int> processed(0);
+    const size_t left = runWatchLoop(watcher, opt.jobs,
+        [&](const std::string& path) { processInput(opt, log, path); ++processed; },
+        [&] {
+            if (!opt.sink->flush())
+                std::cerr << "Warning: Failed to flush outputs\n";
+            std::cout << processed << " images processed, waiting for more" << std::endl;
+        });
+
+    if (left > 0)
+        std::cout << "Stopped with " << left << " arrived images not processed\n";
+    return log.failures == 0 ? 0 : 1;
+}
+
+// Compute state of the smoothing window: blur then fixed-threshold Canny
+// render() only reads the session, so sessions are independent of the UI;
+// both stages are memoized, so the fixed pipeline's sigma 2.0 edges are reused
+struct SmoothingSession {
+    MemoImage gray;
+
+    cv::Mat render(int sigmaSlider) const
+    {
+        return memoCanny(memoGaussianBlur(gray, 0, sliderToSigma(sigmaSlider)), 20, 60).mat;
+    }
+};
+
+#ifndef TOOLKIT_HEADLESS
 // Context for interactive smoothing window
 struct SmoothingUIContext {
-    cv::Mat gray;
+    SmoothingSession session;
     std::string winName;
     std::string trackName;
     int sigmaInit = 20;
+    int sigmaMax = 100;
+    IdlePrefetcher* prefetcher = nullptr;
+    IdleTimer idle;
+    bool suspended = true;  // set while controls are initialized, callbacks skip rendering
 };
 
 // Callback for smoothing trackbar
 static void onSmoothingChange(int /*pos*/, void* userdata)
 {
     auto* ctx = reinterpret_cast<SmoothingUIContext*>(userdata);
-    if (!ctx) return;
-
-    int slider = cv::getTrackbarPos(ctx->trackName, ctx->winName);
-    double sigma = sliderToSigma(slider);
+    if (!ctx || ctx->suspended) return;
 
-    cv::Mat blurred, edges;
-    cv::GaussianBlur(ctx->gray, blurred, cv::Size(0, 0), sigma, sigma);
-    cv::Canny(blurred, edges, 20, 60);
+    if (ctx->prefetcher)
+        ctx->prefetcher->cancel();
+    ctx->idle.changed();
+    safeImShow(ctx->winName, ctx->session.render(cv::getTrackbarPos(ctx->trackName, ctx->winName)));
+}
 
-    safeImShow(ctx->winName, edges);
+// Queue neighboring sigma positions, nearest first, while the slider rests
+static void prefetchSmoothing(SmoothingUIContext& ctx)
+{
+    const int pos = cv::getTrackbarPos(ctx.trackName, ctx.winName);
+    const SmoothingSession* session = &ctx.session;
+    std::vector<IdlePrefetcher::Task> tasks;
+    for (int d : { 1, -1, 2, -2 }) {
+        const int v = pos + d;
+        if (v >= 0 && v <= ctx.sigmaMax)
+            tasks.push_back([session, v] { session->render(v); });
+    }
+    ctx.prefetcher->schedule(std::move(tasks));
 }
+#endif
 
+// Slider positions of the edge detection lab
+struct EdgeLabParams {
+    int kSlider     = 3;
+    int sigmaSlider = 20;
+    int thr1        = 20;
+    int thr2        = 60;
+};
+
+// Compute state of the edge detection lab
+// Blur and Canny are memoized separately, so threshold changes reuse the blur
+struct EdgeLabSession {
+    MemoImage gray;
+
+    // scale < 1 renders a proxy of gray downscaled by scale, with the blur
+    // scaled alongside so the preview matches the full-resolution result
+    cv::Mat render(const EdgeLabParams& p, double scale = 1.0) const
+    {
+        const int ksize = sliderToOddKernel(cvRound(p.kSlider * scale));
+        const double sigma = sliderToSigma(p.sigmaSlider) * scale;
+        return memoCanny(memoGaussianBlur(gray, ksize, sigma), p.thr1, p.thr2).mat;
+    }
+
+    // Whether the full-resolution result of p is already computed
+    bool cached(const EdgeLabParams& p) const
+    {
+        const int ksize = sliderToOddKernel(p.kSlider);
+        const double sigma = sliderToSigma(p.sigmaSlider);
+        const MemoImage blurred { cv::Mat(), memoId("gaussian-blur", blurParams(ksize, sigma), gray) };
+        return memoCached("canny", cannyParams(p.thr1, p.thr2), blurred);
+    }
+};
+
+#ifndef TOOLKIT_HEADLESS
 // Context for edge detection lab window
 struct EdgeLabContext {
-    cv::Mat gray;
+    EdgeLabSession session;
     std::string winName;
     std::string tkK   = "Blur kernel";
     std::string tkSig = "Sigma x10";
     std::string tkT1  = "Canny threshold 1";
     std::string tkT2  = "Canny threshold 2";
-    int initK   = 3;
-    int initSig = 20;
-    int initT1  = 20;
-    int initT2  = 60;
+    EdgeLabParams init;
+    EdgeLabParams max { 15, 100, 255, 255 };
+    EdgeLabSession proxy;              // downscaled gray for coarse previews
+    double proxyScale = 1.0;
+    ProgressiveRenderer* fine = nullptr;
+    IdlePrefetcher* prefetcher = nullptr;
+    IdleTimer idle;
+    bool suspended = true;  // set while controls are initialized, callbacks skip rendering
 };
 
+// Current slider positions of the lab window
+static EdgeLabParams edgeLabPositions(const EdgeLabContext& ctx)
+{
+    EdgeLabParams p;
+    p.kSlider     = cv::getTrackbarPos(ctx.tkK,   ctx.winName);
+    p.sigmaSlider = cv::getTrackbarPos(ctx.tkSig, ctx.winName);
+    p.thr1        = cv::getTrackbarPos(ctx.tkT1,  ctx.winName);
+    p.thr2        = cv::getTrackbarPos(ctx.tkT2,  ctx.winName);
+    return p;
+}
+
 // Callback for edge lab trackbars
 static void onEdgeLabChange(int /*pos*/, void* userdata)
 {
     auto* ctx = reinterpret_cast<EdgeLabContext*>(userdata);
-    if (!ctx) return;
+    if (!ctx || ctx->suspended) return;
+
+    if (ctx->prefetcher)
+        ctx->prefetcher->cancel();
+    ctx->idle.changed();
+    const EdgeLabParams p = edgeLabPositions(*ctx);
+
+    // Small images and cached results are shown directly; otherwise a proxy
+    // preview first, replaced by the full-resolution result from the event loop
+    if (!ctx->fine || ctx->proxyScale >= 1.0 || ctx->session.cached(p)) {
+        if (ctx->fine)
+            ctx->fine->cancel();
+        safeImShow(ctx->winName, ctx->session.render(p));
+        return;
+    }
+    showPreview(ctx->winName, ctx->proxy.render(p, ctx->proxyScale), ctx->session.gray.mat.size());
+    const EdgeLabSession* session = &ctx->session;
+    ctx->fine->request([session, p] { return session->render(p); });
+}
+
+// Queue every one-step neighbor of the current lab settings, the expensive
+// blur parameters first, while the sliders rest
+static void prefetchEdgeLab(EdgeLabContext& ctx)
+{
+    const EdgeLabParams cur = edgeLabPositions(ctx);
+    const EdgeLabSession* session = &ctx.session;
+    std::vector<IdlePrefetcher::Task> tasks;
+    auto add = [&](int EdgeLabParams::*field) {
+        for (int d : { 1, -1 }) {
+            EdgeLabParams p = cur;
+            p.*field += d;
+            if (p.*field >= 0 && p.*field <= ctx.max.*field)
+                tasks.push_back([session, p] { session->render(p); });
+        }
+    };
+    add(&EdgeLabParams::sigmaSlider);
+    add(&EdgeLabParams::kSlider);
+    add(&EdgeLabParams::thr1);
+    add(&EdgeLabParams::thr2);
+    ctx.prefetcher->schedule(std::move(tasks));
+}
+#endif
+
+// Slider positions of the bilateral lab
+struct BilateralParams {
+    int d          = 9;
+    int sigmaColor = 75;
+    int sigmaSpace = 75;
+};
+
+// Compute state of the bilateral lab: bilateral filter + color map, memoized
+// per parameter tuple
+struct BilateralSession {
+    MemoImage input;
+
+    // scale < 1 renders a proxy of input downscaled by scale; the spatial
+    // parameters shrink with it so the proxy looks like the full result
+    // d <= 0 stays 0 (diameter derived from sigmaSpace, which is scaled), a
+    // positive diameter shrinks but never below one pixel
+    cv::Mat render(const BilateralParams& p, double scale = 1.0) const
+    {
+        const int d = p.d <= 0 ? 0 : std::max(1, cvRound(p.d * scale));
+        const double sigmaColor = p.sigmaColor, sigmaSpace = p.sigmaSpace * scale;
+        return memoize("stylize", cv::format("%d/%.2f/%.2f", d, sigmaColor, sigmaSpace), input,
+                       [=](const cv::Mat& src) {
+            cv::Mat bilateral, stylized;
+            cv::bilateralFilter(src, bilateral, d, sigmaColor, sigmaSpace);
+            cv::applyColorMap(bilateral, stylized, cv::COLORMAP_TURBO);
+            return stylized;
+        }).mat;
+    }
+};
+
+#ifndef TOOLKIT_HEADLESS
+// Context for the bilateral lab window
+// Sliders only ever render the display-size proxy; full resolution is
+// rendered when the result is saved
+struct BilateralLabContext {
+    BilateralSession session;
+    BilateralSession proxy;
+    double proxyScale = 1.0;
+    std::string winName;
+    std::string tkD  = "Diameter";
+    std::string tkSC = "Sigma color";
+    std::string tkSS = "Sigma space";
+    BilateralParams init;
+    BilateralParams max { 15, 200, 200 };
+    bool suspended = true;  // set while controls are initialized, callbacks skip rendering
+};
+
+// Current slider positions of the bilateral lab
+static BilateralParams bilateralPositions(const BilateralLabContext& ctx)
+{
+    BilateralParams p;
+    p.d          = cv::getTrackbarPos(ctx.tkD,  ctx.winName);
+    p.sigmaColor = cv::getTrackbarPos(ctx.tkSC, ctx.winName);
+    p.sigmaSpace = cv::getTrackbarPos(ctx.tkSS, ctx.winName);
+    return p;
+}
+
+// Callback for bilateral lab trackbars - proxy results are memoized per tuple
+static void onBilateralChange(int /*pos*/, void* userdata)
+{
+    auto* ctx = reinterpret_cast<BilateralLabContext*>(userdata);
+    if (!ctx || ctx->suspended) return;
+
+    safeImShow(ctx->winName, ctx->proxy.render(bilateralPositions(*ctx), ctx->proxyScale));
+}
+
+// Render the lab settings at full resolution and save them as the stylized effect
+static cv::Mat saveBilateral(const BilateralLabContext& ctx, const std::string& path)
+{
+    const BilateralParams p = bilateralPositions(ctx);
+    cv::Mat stylized = ctx.session.render(p);
+    if (!cv::imwrite(path, stylized))
+        std::cerr << "Warning: Failed to write " << path << "\n";
+    else
+        std::cout << "Saved stylized effect (d " << p.d << ", sigma color " << p.sigmaColor
+                  << ", sigma space " << p.sigmaSpace << ") to " << path << "\n";
+    return stylized;
+}
+#endif
 
-    int kSlider     = cv::getTrackbarPos(ctx->tkK,   ctx->winName);
-    int sigmaSlider = cv::getTrackbarPos(ctx->tkSig, ctx->winName);
-    int thr1Slider  = cv::getTrackbarPos(ctx->tkT1,  ctx->winName);
-    int thr2Slider  = cv::getTrackbarPos(ctx->tkT2,  ctx->winName);
+#ifdef TOOLKIT_HEADLESS
+// Fixed pipeline without windows: the edge map and the stylized effect of the
+// input are written to output.jpg and output_effect.jpg
+static int runPipeline(const std::string& path, bool autoCanny, bool thumbnails,
+                       const ThumbnailSpec& thumbSpec)
+{
+    const cv::Mat input = cv::imread(path, cv::IMREAD_COLOR);
+    if (input.empty()) {
+        std::cerr << "Error: Could not load '" << path << "'\n";
+        return 1;
+    }
 
-    int ksize = sliderToOddKernel(kSlider);
-    double sigma = sliderToSigma(sigmaSlider);
-    double th1 = static_cast<double>(thr1Slider);
-    double th2 = static_cast<double>(thr2Slider);
+    // Same geometry as the windowed pipeline (vertical then horizontal flip);
+    // one run computes every stage once, so nothing is memoized
+    cv::Mat gray;
+    flipViewToGray(FlipView(input, 0).flipped(1), gray);
+    MemoImage blurred, edges;
+    double th1 = 0.0, th2 = 0.0;
+    detectEdges(memoUnregistered(gray), autoCanny, blurred, edges, th1, th2);
+    if (autoCanny)
+        std::cout << "Auto Canny thresholds: " << th1 << "/" << th2 << "\n";
 
-    cv::Mat blurred, edges;
-    cv::GaussianBlur(ctx->gray, blurred, cv::Size(ksize, ksize), sigma, sigma);
-    cv::Canny(blurred, edges, th1, th2);
+    BilateralSession stylizer;
+    stylizer.input = memoUnregistered(input);
+    const cv::Mat stylized = stylizer.render(BilateralParams());
 
-    safeImShow(ctx->winName, edges);
+    FileSink files;
+    int failures = 0;
+    const std::pair<std::string, cv::Mat> outputs[] = {
+        { "output.jpg", edges.mat }, { "output_effect.jpg", stylized }
+    };
+    for (const auto& out : outputs) {
+        if (!cv::imwrite(out.first, out.second)) {
+            std::cerr << "Warning: Failed to write " << out.first << "\n";
+            ++failures;
+            continue;
+        }
+        std::cout << "Saved " << out.first << "\n";
+        if (thumbnails && writeThumbnailPyramid(out.second, out.first, files, thumbSpec) > 0) {
+            std::cerr << "Warning: Failed to write thumbnails of " << out.first << "\n";
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
 }
+#endif
 
-int main()
+// Time and compare each approximate mode against the exact path it replaces
+// on one input: luma decode, strip-fused blur, and the edge and bilateral
+// proxies (scaled back up to full size the way the preview shows them)
+static int reportAccuracy(const std::string& path, int iterations)
 {
-    // Load input image
-    const std::string inputPath = "flower.jpg";
-    cv::Mat input = cv::imread(inputPath, cv::IMREAD_COLOR);
+    const cv::Mat color = cv::imread(path, cv::IMREAD_COLOR);
+    if (color.empty()) {
+        std::cerr << "Error: Could not load '" << path << "'\n";
+        return 1;
+    }
+    printAccuracyHeader(std::cout, color.size(), iterations);
+    ImageError err;
+
+    // Inputs stay unregistered with the memo layer: timed runs must compute
+    // every time instead of hitting the results of the warm-up
+
+    // Luma decode vs color decode + conversion, compared on the edge maps
+    cv::Mat grayRef, grayLuma;
+    MemoImage blurredRef, edgesRef, edgesLuma;
+    double th1 = 0.0, th2 = 0.0;
+    const double colorMs = bestTimeMs([&] {
+        cv::cvtColor(cv::imread(path, cv::IMREAD_COLOR), grayRef, cv::COLOR_BGR2GRAY);
+    }, iterations);
+    const double lumaMs = bestTimeMs([&] { grayLuma = cv::imread(path, cv::IMREAD_GRAYSCALE); }, iterations);
+    detectEdges(memoUnregistered(grayRef), false, blurredRef, edgesRef, th1, th2);
+    detectEdges(memoUnregistered(grayLuma), false, blurredRef, edgesLuma, th1, th2);
+    compareImages(edgesRef.mat, edgesLuma.mat, err);
+    printAccuracyRow(std::cout, "luma decode (edges)", colorMs, lumaMs, err);
+
+    // Strip blur with fused histogram vs whole-image blur + histogram pass;
+    // meant to be exact, so any error here is a bug
+    int hist[256];
+    cv::Mat whole, blurred;
+    const double wholeMs = bestTimeMs([&] {
+        cv::GaussianBlur(grayRef, whole, cv::Size(0, 0), 2.0, 2.0);
+        grayHistogram(whole, hist);
+    }, iterations);
+    const double stripMs = bestTimeMs([&] {
+        blurWithHistogram(grayRef, blurred, cv::Size(0, 0), 2.0, hist);
+    }, iterations);
+    compareImages(whole, blurred, err);
+    printAccuracyRow(std::cout, "strip blur + histogram", wholeMs, stripMs, err);
+
+    // Edge lab proxy at the default settings
+    const double scale = std::min(proxyScale(color.size()), 0.5);
+    const EdgeLabParams lab;
+    EdgeLabSession edgeFull, edgeProxy;
+    edgeFull.gray.mat = grayRef;
+    cv::resize(grayRef, edgeProxy.gray.mat, cv::Size(), scale, scale, cv::INTER_AREA);
+    cv::Mat full, proxy;
+    const double edgeFullMs = bestTimeMs([&] { full = edgeFull.render(lab); }, iterations);
+    const double edgeProxyMs = bestTimeMs([&] { proxy = edgeProxy.render(lab, scale); }, iterations);
+    compareImages(full, upscaleToMatch(proxy, full.size(), true), err);
+    printAccuracyRow(std::cout, cv::format("edge lab proxy 1/%d", cvRound(1.0 / scale)),
+                     edgeFullMs, edgeProxyMs, err);
+
+    // Bilateral lab proxy at the default settings
+    const BilateralParams bp;
+    BilateralSession bilateralFull, bilateralProxy;
+    bilateralFull.input.mat = color;
+    cv::resize(color, bilateralProxy.input.mat, cv::Size(), scale, scale, cv::INTER_AREA);
+    const double bilateralFullMs = bestTimeMs([&] { full = bilateralFull.render(bp); }, iterations);
+    const double bilateralProxyMs = bestTimeMs([&] { proxy = bilateralProxy.render(bp, scale); }, iterations);
+    compareImages(full, upscaleToMatch(proxy, full.size(), false), err);
+    printAccuracyRow(std::cout, cv::format("bilateral proxy 1/%d", cvRound(1.0 / scale)),
+                     bilateralFullMs, bilateralProxyMs, err);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const double startupMs = processStartupMs();
+    const cv::String keys =
+        "{help h usage ? |            | print this message }"
+        "{input          | flower.jpg | input image (glob pattern in batch mode) }"
+        "{auto-canny     |            | derive Canny thresholds from the median of the blurred image }"
+        "{batch          |            | write edges of every --input match without opening windows }"
+        "{watch          |            | keep running and process images arriving in the --input directory (batch options apply) }"
+        "{thumbs         |            | also write 1/2, 1/4, 1/8 and fixed-width thumbnails of each output }"
+        "{thumb-width    | 256        | width of the fixed-width thumbnail }"
+        "{viewer         |            | open the input in the deep-zoom tile viewer }"
+        "{jobs           | 0          | batch mode: inputs processed concurrently (0 = one per CPU) }"
+        "{luma           |            | batch mode: decode straight to grayscale (edge maps only) }"
+        "{accuracy       | 0          | time and compare approximate modes to the exact path over N runs and exit }"
+        "{cache-mb       | 512        | byte budget shared by all result caches, in MB }"
+        "{out-dir        | .          | output directory for batch mode }"
+        "{pack           |            | batch mode: append outputs to pack files in this directory }"
+        "{startup-time   |            | print the time from process start to main (library loading) and exit }";
+
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("OpenCV image manipulation demo");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    if (parser.has("startup-time")) {
+        if (startupMs < 0.0)
+            std::cerr << "Startup time unavailable on this platform\n";
+        else
+            std::cout << "Startup: " << startupMs << " ms from process start to main\n";
+        return 0;
+    }
+
+    const std::string inputPath = parser.get<cv::String>("input");
+    const bool autoCanny = parser.has("auto-canny");
+    if (!parser.check()) {
+        parser.printErrors();
+        return 1;
+    }
+
+    CacheManager::shared().setBudget(size_t(std::max(parser.get<int>("cache-mb"), 0)) << 20);
+    // Edge maps are binary and run-length code to a fraction of their size
+    for (const char* cache : { "gaussian-blur", "canny", TilePyramid::CACHE_NAME })
+        CacheManager::shared().setCompressed(cache, true);
+
+    const bool thumbnails = parser.has("thumbs");
+    ThumbnailSpec thumbSpec;
+    thumbSpec.widths = { parser.get<int>("thumb-width") };
+
+    if (parser.has("batch") || parser.has("watch")) {
+        BatchOptions opt;
+        opt.autoCanny  = autoCanny;
+        opt.thumbnails = thumbnails;
+        opt.thumbSpec  = thumbSpec;
+        opt.jobs       = parser.get<int>("jobs") > 0 ? parser.get<int>("jobs") : cv::getNumberOfCPUs();
+        opt.luma       = parser.has("luma");
+
+        std::string sinkError;
+        std::unique_ptr<OutputSink> sink = makeOutputSink(parser.get<cv::String>("out-dir"),
+            parser.has("pack") ? parser.get<cv::String>("pack") : cv::String(), sinkError);
+        if (!sink) {
+            std::cerr << "Error: " << sinkError << "\n";
+            return 1;
+        }
+        opt.sink = sink.get();
+        return parser.has("watch") ? runWatch(inputPath, opt) : runBatch(inputPath, opt);
+    }
+
+    if (parser.get<int>("accuracy") > 0)
+        return reportAccuracy(inputPath, parser.get<int>("accuracy"));
+
+#ifdef TOOLKIT_HEADLESS
+    if (parser.has("viewer")) {
+        std::cerr << "Error: --viewer needs a build with GUI support\n";
+        return 1;
+    }
+    return runPipeline(inputPath, autoCanny, thumbnails, thumbSpec);
+#else
+    if (parser.has("viewer")) {
+        cv::Mat input = cv::imread(inputPath, cv::IMREAD_COLOR);
+        if (input.empty()) {
+            std::cerr << "Error: Could not load '" << inputPath << "'\n";
+            return 1;
+        }
+
+        // Edge stage of the fixed pipeline, evaluated per visible tile
+        const TileStage edgeStage = [](const cv::Mat& tile) {
+            cv::Mat gray, blurred, edges;
+            cv::cvtColor(tile, gray, cv::COLOR_BGR2GRAY);
+            cv::GaussianBlur(gray, blurred, cv::Size(0, 0), 2.0, 2.0);
+            cv::Canny(blurred, edges, 20, 60);
+            return edges;
+        };
+        runTileViewer("Deep Zoom Viewer", input, edgeStage, 16);
+        CacheManager::shared().printStats(std::cout);
+        return 0;
+    }
+
+    // Load input image on a worker thread while the windows are created
+    std::future<cv::Mat> inputFuture = decodeAsync(inputPath);
+
+    const char* windowNames[] = {
+        "01 Original", "02 Flip Vertical", "03 Flip Horizontal", "04 Rotate 180",
+        "05 Grayscale", "06 Blurred", "07 Edges",
+        "Interactive Smoothing", "Edge Detection Lab", "08 Stylized Effect", "Bilateral Lab"
+    };
+    for (const char* name : windowNames)
+        cv::namedWindow(name, cv::WINDOW_AUTOSIZE);
+
+    cv::Mat input = inputFuture.get();
     if (input.empty()) {
         std::cerr << "Error: Could not load '" << inputPath << "'\n";
+        cv::destroyAllWindows();
         return 1;
     }
 
@@ -121,87 +917,162 @@ int main()
     // Fixed processing pipeline - each step displayed in its own window
     showAndPlace("01 Original", input, START_X + 0*CELL_W, START_Y + 0*CELL_H, MAXSIDE);
 
-    cv::Mat flippedVert;
-    cv::flip(input, flippedVert, 0);
-    showAndPlace("02 Flip Vertical", flippedVert, START_X + 1*CELL_W, START_Y + 0*CELL_H, MAXSIDE);
+    // Flips are views over input; nothing is copied at full resolution
+    const FlipView flippedVert(input, 0);
+    showViewAndPlace("02 Flip Vertical", flippedVert, START_X + 1*CELL_W, START_Y + 0*CELL_H, MAXSIDE);
 
-    cv::Mat flippedHoriz;
-    cv::flip(flippedVert, flippedHoriz, 1);
-    showAndPlace("03 Flip Horizontal", flippedHoriz, START_X + 2*CELL_W, START_Y + 0*CELL_H, MAXSIDE);
+    const FlipView flippedHoriz = flippedVert.flipped(1);
+    showViewAndPlace("03 Flip Horizontal", flippedHoriz, START_X + 2*CELL_W, START_Y + 0*CELL_H, MAXSIDE);
 
-    cv::Mat rotated180;
-    cv::flip(input, rotated180, -1);
-    showAndPlace("04 Rotate 180", rotated180, START_X + 0*CELL_W, START_Y + 1*CELL_H, MAXSIDE);
+    const FlipView rotated180(input, -1);
+    showViewAndPlace("04 Rotate 180", rotated180, START_X + 0*CELL_W, START_Y + 1*CELL_H, MAXSIDE);
 
     cv::Mat gray;
-    cv::cvtColor(flippedHoriz, gray, cv::COLOR_BGR2GRAY);
+    flipViewToGray(flippedHoriz, gray);
     showAndPlace("05 Grayscale", gray, START_X + 1*CELL_W, START_Y + 1*CELL_H, MAXSIDE);
 
-    cv::Mat blurred;
-    cv::GaussianBlur(gray, blurred, cv::Size(0,0), 2.0, 2.0);
+    // Every stage below goes through the memo layer, so the windows that
+    // start from the fixed pipeline's settings reuse its results
+    const MemoImage grayImage = memoSource(gray);
+    MemoImage blurredImage, edgesImage;
+    double th1 = 0.0, th2 = 0.0;
+    detectEdges(grayImage, autoCanny, blurredImage, edgesImage, th1, th2);
+    const cv::Mat& blurred = blurredImage.mat;
+    const cv::Mat& edges = edgesImage.mat;
+    if (autoCanny)
+        std::cout << "Auto Canny thresholds: " << th1 << "/" << th2 << "\n";
     showAndPlace("06 Blurred", blurred, START_X + 2*CELL_W, START_Y + 1*CELL_H, MAXSIDE);
 
-    cv::Mat edges;
-    cv::Canny(blurred, edges, 20, 60);
     showAndPlace("07 Edges", edges, START_X + 0*CELL_W, START_Y + 2*CELL_H, MAXSIDE);
 
     if (!cv::imwrite("output.jpg", edges))
         std::cerr << "Warning: Failed to write output.jpg\n";
     else
         std::cout << "Saved edges to output.jpg\n";
+    FileSink files;
+    if (thumbnails && writeThumbnailPyramid(edges, "output.jpg", files, thumbSpec) > 0)
+        std::cerr << "Warning: Failed to write thumbnails of output.jpg\n";
 
     // Interactive smoothing window with trackbar
     SmoothingUIContext smoothCtx;
-    smoothCtx.gray      = gray;
+    smoothCtx.session.gray = grayImage;
     smoothCtx.winName   = "Interactive Smoothing";
     smoothCtx.trackName = "Sigma x10 (0-100)";
     smoothCtx.sigmaInit = 20;
 
     cv::namedWindow(smoothCtx.winName, cv::WINDOW_AUTOSIZE);
-    cv::createTrackbar(smoothCtx.trackName, smoothCtx.winName, nullptr, 100,
+    cv::createTrackbar(smoothCtx.trackName, smoothCtx.winName, nullptr, smoothCtx.sigmaMax,
                        onSmoothingChange, &smoothCtx);
     cv::setTrackbarPos(smoothCtx.trackName, smoothCtx.winName, smoothCtx.sigmaInit);
+    smoothCtx.suspended = false;
     onSmoothingChange(0, &smoothCtx);
     cv::moveWindow(smoothCtx.winName, START_X + 1*CELL_W, START_Y + 2*CELL_H);
 
     // Edge detection lab with multiple trackbars
     EdgeLabContext lab;
-    lab.gray    = gray;
+    lab.session.gray = grayImage;
+    lab.proxyScale = proxyScale(gray.size());
+    if (lab.proxyScale < 1.0) {
+        cv::Mat proxyGray;
+        cv::resize(gray, proxyGray, cv::Size(), lab.proxyScale, lab.proxyScale, cv::INTER_AREA);
+        lab.proxy.gray = memoSource(proxyGray);
+    }
     lab.winName = "Edge Detection Lab";
+    if (autoCanny) {
+        lab.init.thr1 = cvRound(th1);
+        lab.init.thr2 = cvRound(th2);
+    }
 
     cv::namedWindow(lab.winName, cv::WINDOW_AUTOSIZE);
-    cv::createTrackbar(lab.tkK,   lab.winName, nullptr, 15,  onEdgeLabChange, &lab);
-    cv::createTrackbar(lab.tkSig, lab.winName, nullptr, 100, onEdgeLabChange, &lab);
-    cv::createTrackbar(lab.tkT1,  lab.winName, nullptr, 255, onEdgeLabChange, &lab);
-    cv::createTrackbar(lab.tkT2,  lab.winName, nullptr, 255, onEdgeLabChange, &lab);
-
-    cv::setTrackbarPos(lab.tkK,   lab.winName, lab.initK);
-    cv::setTrackbarPos(lab.tkSig, lab.winName, lab.initSig);
-    cv::setTrackbarPos(lab.tkT1,  lab.winName, lab.initT1);
-    cv::setTrackbarPos(lab.tkT2,  lab.winName, lab.initT2);
+    cv::createTrackbar(lab.tkK,   lab.winName, nullptr, lab.max.kSlider,     onEdgeLabChange, &lab);
+    cv::createTrackbar(lab.tkSig, lab.winName, nullptr, lab.max.sigmaSlider, onEdgeLabChange, &lab);
+    cv::createTrackbar(lab.tkT1,  lab.winName, nullptr, lab.max.thr1,        onEdgeLabChange, &lab);
+    cv::createTrackbar(lab.tkT2,  lab.winName, nullptr, lab.max.thr2,        onEdgeLabChange, &lab);
+
+    cv::setTrackbarPos(lab.tkK,   lab.winName, lab.init.kSlider);
+    cv::setTrackbarPos(lab.tkSig, lab.winName, lab.init.sigmaSlider);
+    cv::setTrackbarPos(lab.tkT1,  lab.winName, lab.init.thr1);
+    cv::setTrackbarPos(lab.tkT2,  lab.winName, lab.init.thr2);
+
+    // Render once after all four trackbars are set
+    lab.suspended = false;
     onEdgeLabChange(0, &lab);
     cv::moveWindow(lab.winName, START_X + 2*CELL_W, START_Y + 2*CELL_H);
 
     // Additional effect: bilateral filter + color mapping
     // Bilateral filter smooths while preserving edges
     // Color map applies a vivid color gradient for artistic effect
-    cv::Mat bilateral, stylized;
-    cv::bilateralFilter(input, bilateral, 9, 75, 75);
-    cv::applyColorMap(bilateral, stylized, cv::COLORMAP_TURBO);
+    // (the bilateral lab's defaults, so saving them unchanged is a memo hit)
+    const MemoImage inputImage = memoSource(input);
+    BilateralSession stylizer;
+    stylizer.input = inputImage;
+    cv::Mat stylized = stylizer.render(BilateralParams());
     showAndPlace("08 Stylized Effect", stylized, START_X + 3*CELL_W, START_Y + 2*CELL_H, MAXSIDE);
 
     if (!cv::imwrite("output_effect.jpg", stylized))
         std::cerr << "Warning: Failed to write output_effect.jpg\n";
     else
         std::cout << "Saved stylized effect to output_effect.jpg\n";
+    if (thumbnails && writeThumbnailPyramid(stylized, "output_effect.jpg", files, thumbSpec) > 0)
+        std::cerr << "Warning: Failed to write thumbnails of output_effect.jpg\n";
+
+    // Bilateral lab on a display-size proxy of the input; 's' saves the
+    // current settings at full resolution
+    BilateralLabContext bilateralLab;
+    bilateralLab.session.input = inputImage;
+    bilateralLab.winName = "Bilateral Lab";
+    bilateralLab.proxyScale = std::min(1.0, static_cast<double>(MAXSIDE) / std::max(input.cols, input.rows));
+    if (bilateralLab.proxyScale < 1.0) {
+        cv::Mat proxyInput;
+        cv::resize(input, proxyInput, cv::Size(), bilateralLab.proxyScale,
+                   bilateralLab.proxyScale, cv::INTER_AREA);
+        bilateralLab.proxy.input = memoSource(proxyInput);
+    } else {
+        bilateralLab.proxy.input = inputImage;
+    }
+
+    cv::createTrackbar(bilateralLab.tkD,  bilateralLab.winName, nullptr, bilateralLab.max.d,          onBilateralChange, &bilateralLab);
+    cv::createTrackbar(bilateralLab.tkSC, bilateralLab.winName, nullptr, bilateralLab.max.sigmaColor, onBilateralChange, &bilateralLab);
+    cv::createTrackbar(bilateralLab.tkSS, bilateralLab.winName, nullptr, bilateralLab.max.sigmaSpace, onBilateralChange, &bilateralLab);
+    cv::setTrackbarPos(bilateralLab.tkD,  bilateralLab.winName, bilateralLab.init.d);
+    cv::setTrackbarPos(bilateralLab.tkSC, bilateralLab.winName, bilateralLab.init.sigmaColor);
+    cv::setTrackbarPos(bilateralLab.tkSS, bilateralLab.winName, bilateralLab.init.sigmaSpace);
+    bilateralLab.suspended = false;
+    onBilateralChange(0, &bilateralLab);
+    cv::moveWindow(bilateralLab.winName, START_X + 3*CELL_W, START_Y + 1*CELL_H);
+
+    // Neighboring slider values are precomputed while the user pauses, and
+    // lab changes on large images render coarse first with the full result
+    // delivered by the event loop; both are declared after the contexts so
+    // their workers stop before the contexts go away
+    IdlePrefetcher prefetcher;
+    ProgressiveRenderer labFine;
+    smoothCtx.prefetcher = &prefetcher;
+    lab.prefetcher = &prefetcher;
+    lab.fine = &labFine;
+    const double IDLE_MS = 150.0;
 
-    // Main loop - wait for ESC or 'q' to exit
+    // Main loop - wait for ESC or 'q' to exit, 's' saves the bilateral lab
     for (;;) {
         int key = cv::waitKey(30);
         if (key == 27 || key == 'q' || key == 'Q')
             break;
+        if (key == 's' || key == 'S') {
+            stylized = saveBilateral(bilateralLab, "output_effect.jpg");
+            showAndPlace("08 Stylized Effect", stylized, START_X + 3*CELL_W, START_Y + 2*CELL_H, MAXSIDE);
+            if (thumbnails && writeThumbnailPyramid(stylized, "output_effect.jpg", files, thumbSpec) > 0)
+                std::cerr << "Warning: Failed to write thumbnails of output_effect.jpg\n";
+        }
+        cv::Mat labEdges;
+        if (labFine.poll(labEdges))
+            safeImShow(lab.winName, labEdges);
+        if (smoothCtx.idle.idleFor(IDLE_MS))
+            prefetchSmoothing(smoothCtx);
+        if (lab.idle.idleFor(IDLE_MS))
+            prefetchEdgeLab(lab);
     }
 
     cv::destroyAllWindows();
     return 0;
+#endif
 }
\ No newline at end of file
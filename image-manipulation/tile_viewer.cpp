@@ -0,0 +1,208 @@
+// Deep-zoom viewer for very large images
+
+#include "tile_viewer.hpp"
+
+#include <opencv2/imgproc.hpp>
+#ifndef TOOLKIT_HEADLESS
+#include <opencv2/highgui.hpp>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+namespace {
+
+const int KIND_LEVEL = 0;
+const int KIND_STAGE = 1;  // stage tiles use KIND_STAGE + stageId
+
+#ifndef TOOLKIT_HEADLESS
+// Convert tile to 3-channel BGR for the viewport canvas
+cv::Mat toBGR(const cv::Mat& tile)
+{
+    if (tile.channels() == 3) return tile;
+    cv::Mat bgr;
+    cv::cvtColor(tile, bgr, cv::COLOR_GRAY2BGR);
+    return bgr;
+}
+#endif
+
+} // namespace
+
+const char* const TilePyramid::CACHE_NAME = "tiles";
+
+TilePyramid::TilePyramid(const cv::Mat& source, int tileSize, CacheManager& cache)
+    : source_(source), tileSize_(tileSize), cache_(cache)
+{
+    static std::atomic<int> nextId(0);
+    id_ = nextId++;
+
+    // Levels halve (rounding up) until the whole level fits in one tile
+    cv::Size sz = source.size();
+    levelSizes_.push_back(sz);
+    while (sz.width > tileSize_ || sz.height > tileSize_) {
+        sz = cv::Size((sz.width + 1) / 2, (sz.height + 1) / 2);
+        levelSizes_.push_back(sz);
+    }
+}
+
+cv::Rect TilePyramid::tileRect(int level, int tx, int ty) const
+{
+    const cv::Size sz = levelSizes_[level];
+    const int x = tx * tileSize_, y = ty * tileSize_;
+    return cv::Rect(x, y, std::min(tileSize_, sz.width - x), std::min(tileSize_, sz.height - y));
+}
+
+std::string TilePyramid::tileKey(int kind, int level, int tx, int ty) const
+{
+    return cv::format("%d/%d/%d/%d/%d", id_, kind, level, tx, ty);
+}
+
+cv::Mat TilePyramid::levelTile(int level, int tx, int ty)
+{
+    // Level 0 tiles are ROIs of the source and need no cache
+    if (level == 0)
+        return source_(tileRect(0, tx, ty));
+
+    const std::string key = tileKey(KIND_LEVEL, level, tx, ty);
+    cv::Mat tile;
+    if (cache_.get(CACHE_NAME, key, tile))
+        return tile;
+    const int64 t0 = cv::getTickCount();
+
+    // Assemble the 2x2 child tiles of the level below and halve them
+    const cv::Rect r = tileRect(level, tx, ty);
+    const cv::Size below = levelSizes_[level - 1];
+    const cv::Rect childRegion(2 * r.x, 2 * r.y,
+                               std::min(2 * r.width,  below.width  - 2 * r.x),
+                               std::min(2 * r.height, below.height - 2 * r.y));
+    cv::Mat children = levelRegion(level - 1, childRegion);
+    cv::resize(children, tile, r.size(), 0, 0, cv::INTER_AREA);
+
+    cache_.put(CACHE_NAME, key, tile, (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency());
+    return tile;
+}
+
+cv::Mat TilePyramid::levelRegion(int level, const cv::Rect& region)
+{
+    const int tx0 = region.x / tileSize_, tx1 = (region.x + region.width  - 1) / tileSize_;
+    const int ty0 = region.y / tileSize_, ty1 = (region.y + region.height - 1) / tileSize_;
+
+    // Region inside a single tile: return a view, no copy
+    if (tx0 == tx1 && ty0 == ty1) {
+        const cv::Rect tr = tileRect(level, tx0, ty0);
+        return levelTile(level, tx0, ty0)(cv::Rect(region.x - tr.x, region.y - tr.y,
+                                                   region.width, region.height));
+    }
+
+    cv::Mat out(region.size(), source_.type());
+    for (int ty = ty0; ty <= ty1; ++ty)
+    for (int tx = tx0; tx <= tx1; ++tx) {
+        const cv::Rect tr = tileRect(level, tx, ty);
+        const cv::Rect overlap = tr & region;
+        levelTile(level, tx, ty)(cv::Rect(overlap.x - tr.x, overlap.y - tr.y,
+                                          overlap.width, overlap.height))
+            .copyTo(out(cv::Rect(overlap.x - region.x, overlap.y - region.y,
+                                 overlap.width, overlap.height)));
+    }
+    return out;
+}
+
+cv::Mat TilePyramid::stageTile(int level, int tx, int ty, const TileStage& stage,
+                               int margin, int stageId)
+{
+    const std::string key = tileKey(KIND_STAGE + stageId, level, tx, ty);
+    cv::Mat tile;
+    if (cache_.get(CACHE_NAME, key, tile))
+        return tile;
+    const int64 t0 = cv::getTickCount();
+
+    // Process the tile with surrounding context so filters see real neighbors
+    const cv::Rect r = tileRect(level, tx, ty);
+    const cv::Size sz = levelSizes_[level];
+    const cv::Rect withContext = cv::Rect(r.x - margin, r.y - margin,
+                                          r.width + 2 * margin, r.height + 2 * margin)
+                               & cv::Rect(0, 0, sz.width, sz.height);
+
+    cv::Mat processed = stage(levelRegion(level, withContext));
+    tile = processed(cv::Rect(r.x - withContext.x, r.y - withContext.y, r.width, r.height)).clone();
+
+    cache_.put(CACHE_NAME, key, tile, (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency());
+    return tile;
+}
+
+#ifndef TOOLKIT_HEADLESS
+void runTileViewer(const std::string& winName, const cv::Mat& image,
+                   const TileStage& stage, int stageMargin, cv::Size viewport)
+{
+    TilePyramid pyramid(image);
+
+    // Start zoomed out to the first level that fits in the viewport
+    int level = 0;
+    while (level + 1 < pyramid.levels() &&
+           (pyramid.levelSize(level).width > viewport.width ||
+            pyramid.levelSize(level).height > viewport.height))
+        ++level;
+
+    // Viewport center in level-0 coordinates, kept across zoom changes
+    double cx = image.cols / 2.0, cy = image.rows / 2.0;
+    bool showStage = false;
+    const int T = pyramid.tileSize();
+
+    cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
+    for (;;) {
+        const cv::Size lsz = pyramid.levelSize(level);
+        const double scale = static_cast<double>(lsz.width) / image.cols;
+        const cv::Size view(std::min(viewport.width, lsz.width), std::min(viewport.height, lsz.height));
+
+        // Clamp the view to the level bounds
+        int x0 = static_cast<int>(cx * scale) - view.width / 2;
+        int y0 = static_cast<int>(cy * scale) - view.height / 2;
+        x0 = std::max(0, std::min(x0, lsz.width - view.width));
+        y0 = std::max(0, std::min(y0, lsz.height - view.height));
+        const cv::Rect visible(x0, y0, view.width, view.height);
+
+        // Fetch only the tiles intersecting the visible rectangle
+        cv::Mat canvas(view, CV_8UC3, cv::Scalar::all(0));
+        for (int ty = y0 / T; ty <= (y0 + view.height - 1) / T; ++ty)
+        for (int tx = x0 / T; tx <= (x0 + view.width - 1) / T; ++tx) {
+            cv::Mat tile = showStage ? pyramid.stageTile(level, tx, ty, stage, stageMargin, 0)
+                                     : pyramid.levelTile(level, tx, ty);
+            const cv::Rect tr(tx * T, ty * T, tile.cols, tile.rows);
+            const cv::Rect overlap = tr & visible;
+            toBGR(tile)(cv::Rect(overlap.x - tr.x, overlap.y - tr.y, overlap.width, overlap.height))
+                .copyTo(canvas(cv::Rect(overlap.x - x0, overlap.y - y0, overlap.width, overlap.height)));
+        }
+
+        const CacheManager::Stats cs = pyramid.cacheStats();
+        cv::putText(canvas, cv::format("level %d/%d  %s  cache %zu MB (%zu hit / %zu miss / %zu evicted)",
+                                       level, pyramid.levels() - 1, showStage ? "stage" : "image",
+                                       cs.bytes >> 20, cs.hits, cs.misses, cs.evictions),
+                    cv::Point(10, 20), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255), 1, cv::LINE_AA);
+        cv::imshow(winName, canvas);
+
+        const int key = cv::waitKeyEx(0);
+        const double step = 0.25 * std::min(view.width, view.height) / scale;
+        if (key == 27 || key == 'q' || key == 'Q' || key < 0)
+            break;
+        else if ((key == '+' || key == '=') && level > 0)
+            --level;
+        else if (key == '-' && level + 1 < pyramid.levels())
+            ++level;
+        else if (key == 'e' || key == 'E')
+            showStage = !showStage;
+        else if (key == 'a' || key == 0x250000 || key == 65361)
+            cx -= step;
+        else if (key == 'd' || key == 0x270000 || key == 65363)
+            cx += step;
+        else if (key == 'w' || key == 0x260000 || key == 65362)
+            cy -= step;
+        else if (key == 's' || key == 0x280000 || key == 65364)
+            cy += step;
+
+        cx = std::max(0.0, std::min(cx, static_cast<double>(image.cols)));
+        cy = std::max(0.0, std::min(cy, static_cast<double>(image.rows)));
+    }
+
+    cv::destroyWindow(winName);
+}
+#endif
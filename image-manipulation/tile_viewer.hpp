@@ -0,0 +1,59 @@
+// Deep-zoom viewer for very large images
+// The image is split into a lazily built multi-level tile pyramid; only
+// tiles visible at the current zoom/pan are downsampled or processed, and
+// tiles are kept in the shared result cache (see cache_manager.hpp)
+
+#pragma once
+
+#include "cache_manager.hpp"
+
+#include <opencv2/core.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Processing applied to one tile of a pyramid level
+// Input is the tile plus `margin` pixels of context on each side (clamped at
+// the level borders); output must have the same size as the input
+using TileStage = std::function<cv::Mat(const cv::Mat& tileWithContext)>;
+
+class TilePyramid
+{
+public:
+    TilePyramid(const cv::Mat& source, int tileSize = 256,
+                CacheManager& cache = CacheManager::shared());
+
+    int levels() const { return static_cast<int>(levelSizes_.size()); }
+    int tileSize() const { return tileSize_; }
+    cv::Size levelSize(int level) const { return levelSizes_[level]; }
+
+    // Tile (tx, ty) of pyramid level `level` (level 0 = full resolution)
+    // Level tiles are downsampled from the four tiles below them on demand
+    cv::Mat levelTile(int level, int tx, int ty);
+
+    // Stage output for a tile, computed on demand from the tile and its context
+    cv::Mat stageTile(int level, int tx, int ty, const TileStage& stage, int margin, int stageId);
+
+    // Statistics of the "tiles" cache (shared by all pyramids)
+    CacheManager::Stats cacheStats() const { return cache_.stats(CACHE_NAME); }
+
+    static const char* const CACHE_NAME;
+
+private:
+    cv::Rect tileRect(int level, int tx, int ty) const;
+    cv::Mat levelRegion(int level, const cv::Rect& region);
+    std::string tileKey(int kind, int level, int tx, int ty) const;
+
+    cv::Mat source_;
+    int tileSize_;
+    CacheManager& cache_;
+    int id_;  // keeps tiles of different pyramids apart in the shared cache
+    std::vector<cv::Size> levelSizes_;
+};
+
+#ifndef TOOLKIT_HEADLESS
+// Interactive viewer: +/- zoom, WASD or arrows pan, 'e' toggles the stage,
+// ESC or 'q' quits
+void runTileViewer(const std::string& winName, const cv::Mat& image,
+                   const TileStage& stage, int stageMargin, cv::Size viewport = cv::Size(1024, 768));
+#endif
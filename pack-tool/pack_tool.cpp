@@ -0,0 +1,72 @@
+// Pack archive reader
+// Lists or extracts entries written by the --pack output sink of chroma_key
+// and image-manipulation; entries are read from memory-mapped packs and
+// extracted as the encoded files they were written as
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "pack_archive.hpp"
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    const cv::String keys =
+        "{help h usage ? |   | print this message }"
+        "{@command       |   | list, extract or extract-all }"
+        "{@archive       |   | pack archive directory }"
+        "{@key           |   | entry key (extract) or output directory (extract-all) }"
+        "{@out           |   | output file for extract (default: the key) }";
+
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("Pack archive reader");
+    const std::string command = parser.get<cv::String>(0);
+    const std::string archive = parser.get<cv::String>(1);
+    if (parser.has("help") || command.empty() || archive.empty()) {
+        parser.printMessage();
+        return parser.has("help") ? 0 : 1;
+    }
+
+    PackReader reader(archive);
+    if (!reader.isOpen()) {
+        std::cerr << "Error: No index.txt in '" << archive << "'\n";
+        return 1;
+    }
+
+    if (command == "list") {
+        for (const std::string& key : reader.keys()) {
+            size_t length = 0;
+            reader.map(key, length);
+            std::cout << key << "\t" << length << "\n";
+        }
+        return 0;
+    }
+
+    if (command == "extract") {
+        const std::string key = parser.get<cv::String>(2);
+        std::string out = parser.get<cv::String>(3);
+        if (out.empty()) out = key;
+        if (!reader.extract(key, out)) {
+            std::cerr << "Error: Could not extract '" << key << "'\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (command == "extract-all") {
+        std::string outDir = parser.get<cv::String>(2);
+        if (outDir.empty()) outDir = ".";
+        int failures = 0;
+        for (const std::string& key : reader.keys()) {
+            if (!reader.extract(key, outDir + "/" + key)) {
+                std::cerr << "Warning: Could not extract '" << key << "'\n";
+                ++failures;
+            }
+        }
+        std::cout << "Extracted " << reader.keys().size() - failures << " entries\n";
+        return failures == 0 ? 0 : 1;
+    }
+
+    std::cerr << "Error: Unknown command '" << command << "'\n";
+    return 1;
+}